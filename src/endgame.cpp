@@ -0,0 +1,219 @@
+#include "endgame.hpp"
+#include "bitboards.hpp"
+#include "misc.hpp"
+#include "position.hpp"
+#include <bitset>
+#include <vector>
+
+namespace
+{
+// KPK bitbase : whether white wins with king and pawn against king, by side to
+// move, king squares and pawn square. The pawn is on files A to D and ranks 2
+// to 7, other positions are mirrored before probing.
+constexpr unsigned KPK_SIZE = 2 * 24 * 64 * 64;
+std::bitset<KPK_SIZE> kpkWins;
+
+inline unsigned kpk_index(Color stm, Square bksq, Square wksq, Square psq)
+{
+  return wksq | bksq << 6 | stm << 12 | file_of(psq) << 13 |
+         (RANK_7 - rank_of(psq)) << 15;
+}
+
+enum KPKResult : uint8_t
+{
+  INVALID = 0,
+  UNKNOWN = 1,
+  DRAW = 2,
+  WIN = 4
+};
+
+inline KPKResult &operator|=(KPKResult &r, KPKResult v)
+{
+  return r = KPKResult(r | v);
+}
+
+// Retrograde analysis : positions are classified from the ones they lead to,
+// until nothing changes. A position is a win for its side to move if one move
+// reaches a win, a loss if all of them do.
+struct KPKPosition
+{
+  KPKPosition() = default;
+  explicit KPKPosition(unsigned idx);
+  KPKResult classify(std::vector<KPKPosition> const &db);
+
+  Color stm;
+  Square ksq[NB_COLOR];
+  Square psq;
+  KPKResult result;
+};
+
+KPKPosition::KPKPosition(unsigned idx)
+{
+  ksq[WHITE] = Square(idx & 0x3f);
+  ksq[BLACK] = Square((idx >> 6) & 0x3f);
+  stm = Color((idx >> 12) & 1);
+  psq = make_square(File((idx >> 13) & 3), Rank(RANK_7 - (idx >> 15)));
+  Square push = psq + NORTH;
+  if (square_distance(ksq[WHITE], ksq[BLACK]) <= 1 || ksq[WHITE] == psq ||
+      ksq[BLACK] == psq ||
+      (stm == WHITE && (pawnPseudoAttack[psq][WHITE] & ksq[BLACK])))
+    result = INVALID;
+  // Promotes without losing the new queen
+  else if (stm == WHITE && rank_of(psq) == RANK_7 && ksq[WHITE] != push &&
+           (square_distance(ksq[BLACK], push) > 1 ||
+            square_distance(ksq[WHITE], push) == 1))
+    result = WIN;
+  // Stalemate, or the pawn is taken
+  else if (stm == BLACK &&
+           (!(ringBB[ksq[BLACK]] &
+              ~(ringBB[ksq[WHITE]] | pawnPseudoAttack[psq][WHITE])) ||
+            (ringBB[ksq[BLACK]] & psq & ~ringBB[ksq[WHITE]])))
+    result = DRAW;
+  else
+    result = UNKNOWN;
+}
+
+KPKResult KPKPosition::classify(std::vector<KPKPosition> const &db)
+{
+  KPKResult good = stm == WHITE ? WIN : DRAW;
+  KPKResult bad = stm == WHITE ? DRAW : WIN;
+  KPKResult r = INVALID;
+  Bitboard b = ringBB[ksq[stm]];
+  while (b)
+  {
+    Square to = pop_lsb(b);
+    r |= stm == WHITE ? db[kpk_index(BLACK, ksq[BLACK], to, psq)].result
+                      : db[kpk_index(WHITE, to, ksq[WHITE], psq)].result;
+  }
+  if (stm == WHITE)
+  {
+    Square push = psq + NORTH;
+    if (rank_of(psq) < RANK_7)
+      r |= db[kpk_index(BLACK, ksq[BLACK], ksq[WHITE], push)].result;
+    if (rank_of(psq) == RANK_2 && push != ksq[WHITE] && push != ksq[BLACK])
+      r |= db[kpk_index(BLACK, ksq[BLACK], ksq[WHITE], push + NORTH)].result;
+  }
+  return result = r & good ? good : r & UNKNOWN ? UNKNOWN : bad;
+}
+
+void kpk_init()
+{
+  std::vector<KPKPosition> db(KPK_SIZE);
+  for (unsigned idx = 0; idx < KPK_SIZE; ++idx)
+    db[idx] = KPKPosition(idx);
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (KPKPosition &p : db)
+      if (p.result == UNKNOWN && p.classify(db) != UNKNOWN)
+        changed = true;
+  }
+  for (unsigned idx = 0; idx < KPK_SIZE; ++idx)
+    kpkWins[idx] = db[idx].result == WIN;
+}
+
+// Bonuses to drive the weak king to the edge, and the strong king to it
+inline int push_to_edge(Square sq)
+{
+  int f = file_of(sq), r = rank_of(sq);
+  return 20 * (6 - std::min(f, 7 - f) - std::min(r, 7 - r));
+}
+
+inline int push_close(Square sq1, Square sq2)
+{
+  return 140 - 20 * square_distance(sq1, sq2);
+}
+
+inline Square lsb(Bitboard b) { return pop_lsb(b); }
+
+Value kpk(Position const &pos, Color strongSide)
+{
+  Square wksq = pos.king_square(strongSide);
+  Square bksq = pos.king_square(!strongSide);
+  Square psq = lsb(pos.pieces(PAWN, strongSide));
+  Color stm = pos.side_to_move();
+  // Seen from white, with the pawn on the queen side
+  if (strongSide == BLACK)
+  {
+    wksq = Square(wksq ^ 56);
+    bksq = Square(bksq ^ 56);
+    psq = Square(psq ^ 56);
+    stm = !stm;
+  }
+  if (file_of(psq) >= FILE_E)
+  {
+    wksq = Square(wksq ^ 7);
+    bksq = Square(bksq ^ 7);
+    psq = Square(psq ^ 7);
+  }
+  if (!kpkWins[kpk_index(stm, bksq, wksq, psq)])
+    return VALUE_DRAW;
+  return Value(VALUE_KNOWN_WIN + PawnValue + 8 * rank_of(psq));
+}
+
+// The mate needs the weak king in a corner of the color of the bishop
+Value kbnk(Position const &pos, Color strongSide)
+{
+  Square winner = pos.king_square(strongSide);
+  Square loser = pos.king_square(!strongSide);
+  Square bsq = lsb(pos.pieces(BISHOP, strongSide));
+  bool dark = !((file_of(bsq) + rank_of(bsq)) & 1);
+  int corner = dark ? std::min(square_distance(loser, SQ_A1),
+                               square_distance(loser, SQ_H8))
+                    : std::min(square_distance(loser, SQ_A8),
+                               square_distance(loser, SQ_H1));
+  return Value(VALUE_KNOWN_WIN + 70 * (7 - corner) + push_close(winner, loser));
+}
+
+// Endgames recognized by their material key
+struct KnownEndgame
+{
+  Key key;
+  EndgameFn fn;
+  Color strongSide;
+};
+KnownEndgame knownEndgames[4];
+} // namespace
+
+void Endgames::init()
+{
+  kpk_init();
+  int i = 0;
+  for (Color c : {WHITE, BLACK})
+  {
+    knownEndgames[i++] = {material_key("KP", "K", c), kpk, c};
+    knownEndgames[i++] = {material_key("KBN", "K", c), kbnk, c};
+  }
+}
+
+EndgameFn Endgames::probe(Key materialKey, Color &strongSide)
+{
+  for (KnownEndgame const &e : knownEndgames)
+    if (e.key == materialKey)
+    {
+      strongSide = e.strongSide;
+      return e.fn;
+    }
+  return nullptr;
+}
+
+// Pawns of the strong side only count as material : with enough to mate
+// without them, the pawn endings draws (rook pawn, wrong bishop) do not apply
+Value Endgames::kxk(Position const &pos, Color strongSide)
+{
+  // A bare king that cannot move is stalemated
+  if (pos.side_to_move() != strongSide && !pos.in_check() &&
+      !pos.count_moves())
+    return VALUE_DRAW;
+  Square winner = pos.king_square(strongSide);
+  Square loser = pos.king_square(!strongSide);
+  int material = 0;
+  for (PieceType pt = PAWN; pt < KING; pt = PieceType(pt + 1))
+    material += pieceValue[pt] * pos.count(make_piece(strongSide, pt));
+  return Value(std::min<int>(VALUE_KNOWN_WIN + material + push_to_edge(loser) +
+                                 push_close(winner, loser),
+                             VALUE_TB_WIN_IN_MAX_PLY - 1));
+}
+
+Value Endgames::draw(Position const &, Color) { return VALUE_DRAW; }
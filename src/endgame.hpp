@@ -0,0 +1,24 @@
+#ifndef ENDGAME_INCLUDED
+#define ENDGAME_INCLUDED
+#include "types.hpp"
+
+class Position;
+
+// Evaluation of an endgame the general one gets wrong, from the point of view
+// of the strong side
+using EndgameFn = Value (*)(Position const &pos, Color strongSide);
+
+namespace Endgames
+{
+// Builds the KPK bitbase and the keys of the known endgames, after
+// zobrist_init() and bitboard_init()
+void init();
+// Specialized evaluation for a material key, nullptr if there is none
+EndgameFn probe(Key materialKey, Color &strongSide);
+// Bare king against enough material to mate
+Value kxk(Position const &pos, Color strongSide);
+// Insufficient material on both sides
+Value draw(Position const &pos, Color strongSide);
+} // namespace Endgames
+
+#endif
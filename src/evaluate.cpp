@@ -0,0 +1,390 @@
+#include "evaluate.hpp"
+#include "bitboards.hpp"
+#include "position.hpp"
+
+Score Eval::psqt[NB_PIECE][NB_SQUARE];
+
+namespace
+{
+#define S(mg, eg) Score{mg, eg}
+
+constexpr Value pieceValueEg[NB_PIECE_TYPE] = {0, 213, 854, 915, 1380, 2682,
+                                               0, 0};
+
+// Piece-square bonuses of white pieces by rank and file. Apart from pawns, the
+// tables are symmetric and only give files A to D.
+constexpr Score pawnBonus[NB_RANK][NB_FILE] = {
+    {},
+    {S(3, -10), S(3, -6), S(10, 10), S(19, 0), S(16, 14), S(19, 7), S(7, -5),
+     S(-5, -19)},
+    {S(-9, -10), S(-15, -10), S(11, -10), S(15, 4), S(32, 4), S(22, 3),
+     S(5, -6), S(-22, -4)},
+    {S(-8, 6), S(-23, -2), S(6, -8), S(20, -4), S(40, -13), S(17, -12),
+     S(4, -10), S(-12, -9)},
+    {S(13, 9), S(0, 4), S(-13, 3), S(1, -12), S(11, -12), S(-2, -6),
+     S(-13, 13), S(5, 8)},
+    {S(-5, 28), S(-12, 20), S(-7, 21), S(22, 28), S(-8, 30), S(-5, 7),
+     S(-15, 6), S(-18, 13)},
+    {S(-7, 0), S(7, -11), S(-3, 12), S(-13, 21), S(5, 25), S(-16, 19),
+     S(10, 4), S(-8, 7)},
+    {}};
+
+constexpr Score pieceBonus[NB_PIECE_TYPE][NB_RANK][NB_FILE / 2] = {
+    {},
+    {},
+    {// Knight
+     {S(-175, -96), S(-92, -65), S(-74, -49), S(-73, -21)},
+     {S(-77, -67), S(-41, -54), S(-27, -18), S(-15, 8)},
+     {S(-61, -40), S(-17, -27), S(6, -8), S(12, 29)},
+     {S(-35, -35), S(8, -2), S(40, 13), S(49, 28)},
+     {S(-34, -45), S(13, -16), S(44, 9), S(51, 39)},
+     {S(-9, -51), S(22, -44), S(58, -16), S(53, 17)},
+     {S(-67, -69), S(-27, -50), S(4, -51), S(37, 12)},
+     {S(-201, -100), S(-83, -88), S(-56, -56), S(-26, -17)}},
+    {// Bishop
+     {S(-53, -57), S(-5, -30), S(-8, -37), S(-23, -12)},
+     {S(-15, -37), S(8, -13), S(19, -17), S(4, 1)},
+     {S(-7, -16), S(21, -1), S(-5, -2), S(17, 10)},
+     {S(-5, -20), S(11, -6), S(25, 0), S(39, 17)},
+     {S(-12, -17), S(29, -1), S(22, -14), S(31, 15)},
+     {S(-16, -30), S(6, 6), S(1, 4), S(11, 6)},
+     {S(-17, -31), S(-14, -20), S(5, -1), S(0, 1)},
+     {S(-48, -46), S(1, -42), S(-14, -37), S(-23, -24)}},
+    {// Rook
+     {S(-31, -9), S(-20, -13), S(-14, -10), S(-5, -9)},
+     {S(-21, -12), S(-13, -9), S(-8, -1), S(6, -2)},
+     {S(-25, 6), S(-11, -8), S(-1, -2), S(3, -6)},
+     {S(-13, -6), S(-5, 1), S(-4, -9), S(-6, 7)},
+     {S(-27, -5), S(-15, 8), S(-4, 7), S(3, -6)},
+     {S(-22, 6), S(-2, 1), S(6, -7), S(12, 10)},
+     {S(-2, 4), S(12, 5), S(16, 20), S(18, -5)},
+     {S(-17, 18), S(-19, 0), S(-1, 19), S(9, 13)}},
+    {// Queen
+     {S(3, -69), S(-5, -57), S(-5, -47), S(4, -26)},
+     {S(-3, -55), S(5, -31), S(8, -22), S(12, -4)},
+     {S(-3, -39), S(6, -18), S(13, -9), S(7, 3)},
+     {S(4, -23), S(5, -3), S(9, 13), S(8, 24)},
+     {S(0, -29), S(14, -6), S(12, 9), S(5, 21)},
+     {S(-4, -38), S(10, -18), S(6, -12), S(8, 1)},
+     {S(-5, -50), S(6, -27), S(10, -24), S(8, -8)},
+     {S(-2, -75), S(-2, -52), S(1, -43), S(-2, -36)}},
+    {// King
+     {S(271, 1), S(327, 45), S(271, 85), S(198, 76)},
+     {S(278, 53), S(303, 100), S(234, 133), S(179, 135)},
+     {S(195, 88), S(258, 130), S(169, 169), S(120, 175)},
+     {S(164, 103), S(190, 156), S(138, 172), S(98, 172)},
+     {S(154, 96), S(179, 166), S(105, 199), S(70, 199)},
+     {S(123, 92), S(145, 172), S(81, 184), S(31, 191)},
+     {S(88, 47), S(120, 121), S(65, 116), S(33, 131)},
+     {S(59, 11), S(89, 59), S(45, 73), S(-1, 78)}}};
+
+// By number of attacked squares in the mobility area, for knights to queens
+constexpr Score mobilityBonus[4][28] = {
+    {S(-62, -81), S(-53, -56), S(-12, -30), S(-4, -14), S(3, 8), S(13, 15),
+     S(22, 23), S(28, 27), S(33, 33)},
+    {S(-48, -59), S(-20, -23), S(16, -3), S(26, 13), S(38, 24), S(51, 42),
+     S(55, 54), S(63, 57), S(63, 65), S(68, 73), S(81, 78), S(81, 86),
+     S(91, 88), S(98, 97)},
+    {S(-58, -76), S(-27, -18), S(-15, 28), S(-10, 55), S(-5, 69), S(-2, 82),
+     S(9, 112), S(16, 118), S(30, 132), S(29, 142), S(32, 155), S(38, 165),
+     S(46, 166), S(48, 169), S(58, 171)},
+    {S(-39, -36), S(-21, -15), S(3, 8),     S(3, 18),    S(14, 34),
+     S(22, 54),   S(28, 61),   S(41, 73),   S(43, 79),   S(48, 92),
+     S(56, 94),   S(60, 104),  S(60, 113),  S(66, 120),  S(67, 123),
+     S(70, 126),  S(71, 133),  S(73, 136),  S(79, 140),  S(88, 143),
+     S(88, 148),  S(99, 166),  S(102, 170), S(102, 175), S(106, 184),
+     S(109, 191), S(113, 206), S(116, 212)}};
+
+// By relative rank
+constexpr Score passedRank[NB_RANK] = {
+    S(0, 0),     S(10, 28),   S(17, 33),   S(15, 41),
+    S(62, 72),   S(168, 177), S(276, 260), S(0, 0)};
+
+constexpr int kingAttackWeight[NB_PIECE_TYPE] = {0, 0, 81, 52, 44, 10, 0, 0};
+
+constexpr Score bishopPair = S(40, 70);
+// Knights gain and rooks lose value with each pawn of their side above five
+constexpr Score knightPawn = S(8, 8);
+constexpr Score rookPawn = S(16, 16);
+
+constexpr Score doubled = S(-11, -56);
+constexpr Score isolated = S(-5, -15);
+constexpr Score rookOpenFile = S(48, 29);
+constexpr Score rookSemiOpenFile = S(19, 7);
+constexpr Score noShelter = S(-20, 0);
+constexpr Value tempo = 28;
+
+#undef S
+
+struct EvalInfo
+{
+  Bitboard pawnAttacks[NB_COLOR];
+  Bitboard attacked[NB_COLOR];
+  // Squares not occupied by our pawns or king, nor attacked by their pawns
+  Bitboard mobilityArea[NB_COLOR];
+  Bitboard kingRing[NB_COLOR];
+  // Pieces attacking the enemy king ring, their weight, and their attacks on
+  // the squares next to the king
+  int kingAttackers[NB_COLOR];
+  int kingAttackersWeight[NB_COLOR];
+  int kingAttacks[NB_COLOR];
+};
+
+inline Rank relative_rank(Color c, Square sq)
+{
+  return c == WHITE ? rank_of(sq) : Rank(RANK_8 - rank_of(sq));
+}
+
+template <Color c>
+inline Bitboard pawn_attacks(Bitboard pawns)
+{
+  return c == WHITE ? shift<NORTH_EAST>(pawns) | shift<NORTH_WEST>(pawns)
+                    : shift<SOUTH_EAST>(pawns) | shift<SOUTH_WEST>(pawns);
+}
+
+template <Color us>
+void init_info(Position const &pos, EvalInfo &ei)
+{
+  constexpr Color them = !us;
+  Square ksq = pos.king_square(us);
+  ei.attacked[us] = ei.pawnAttacks[us] | ringBB[ksq];
+  ei.mobilityArea[us] =
+      ~(pos.pieces(PAWN, KING) & pos.pieces(us)) & ~ei.pawnAttacks[them];
+  ei.kingRing[us] = ringBB[ksq] | ksq;
+  ei.kingAttackers[them] = popcount(ei.kingRing[us] & ei.pawnAttacks[them]);
+  ei.kingAttackersWeight[them] = ei.kingAttacks[them] = 0;
+}
+
+template <Color us, PieceType pt>
+Score evaluate_pieces(Position const &pos, EvalInfo &ei)
+{
+  constexpr Color them = !us;
+  Score s{0, 0};
+  Bitboard bb = pos.pieces(pt, us);
+  while (bb)
+  {
+    Square sq = pop_lsb(bb);
+    Bitboard b = pos.attacks_from<pt>(sq);
+    ei.attacked[us] |= b;
+    if (b & ei.kingRing[them])
+    {
+      ++ei.kingAttackers[us];
+      ei.kingAttackersWeight[us] += kingAttackWeight[pt];
+      ei.kingAttacks[us] += popcount(b & ringBB[pos.king_square(them)]);
+    }
+    s += mobilityBonus[pt - KNIGHT][popcount(b & ei.mobilityArea[us])];
+    if (pt == ROOK && !(pos.pieces(PAWN, us) & file_of(sq)))
+      s += pos.pieces(PAWN, them) & file_of(sq) ? rookSemiOpenFile
+                                                : rookOpenFile;
+  }
+  return s;
+}
+
+template <Color us>
+Score evaluate_pawns(Position const &pos, PawnEntry &e)
+{
+  constexpr Color them = !us;
+  Score s{0, 0};
+  Bitboard ours = pos.pieces(PAWN, us), theirs = pos.pieces(PAWN, them);
+  Bitboard bb = ours;
+  e.passed[us] = e.isolated[us] = e.doubled[us] = 0;
+  while (bb)
+  {
+    Square sq = pop_lsb(bb);
+    // Only the rear pawn of a file is doubled, only the front one can pass
+    if (ours & forwardFileBB[sq][us])
+    {
+      e.doubled[us] |= sq;
+      s += doubled;
+    }
+    else if (!(theirs & passedPawnMaskBB[sq][us]))
+    {
+      e.passed[us] |= sq;
+      s += passedRank[relative_rank(us, sq)];
+    }
+    if (!(ours & adjacentFilesBB[file_of(sq)]))
+    {
+      e.isolated[us] |= sq;
+      s += isolated;
+    }
+  }
+  return s;
+}
+
+// Pawn structure from the table of the thread when it has one. Pawn keys
+// rarely change along a search, so most probes hit.
+PawnEntry const *pawn_entry(Position const &pos, PawnEntry &local)
+{
+  Key k = pos.pawn_key();
+  PawnEntry *e = &local;
+  if (PawnTable *table = pos.pawn_table())
+  {
+    bool hit;
+    e = table->probe_local(k, hit);
+    if (hit)
+      return e;
+  }
+  e->key = k;
+  e->score = evaluate_pawns<WHITE>(pos, *e) - evaluate_pawns<BLACK>(pos, *e);
+  return e;
+}
+
+// Passed pawns in the end game are worth more when the enemy king is far from
+// their path, and ours close
+template <Color us>
+Score evaluate_passed(Position const &pos, PawnEntry const &e)
+{
+  constexpr Color them = !us;
+  Score s{0, 0};
+  Bitboard bb = e.passed[us];
+  while (bb)
+  {
+    Square sq = pop_lsb(bb);
+    int r = relative_rank(us, sq);
+    if (r < RANK_4)
+      continue;
+    Square blockSq = sq + up(us);
+    int bonus = 5 * square_distance(pos.king_square(them), blockSq) -
+                2 * square_distance(pos.king_square(us), blockSq);
+    s += Score{0, Value(bonus * (5 * r - 13))};
+  }
+  return s;
+}
+
+template <Color us>
+Score imbalance(Position const &pos)
+{
+  Score s = (pos.count(make_piece(us, PAWN)) - 5) *
+            (pos.count(make_piece(us, KNIGHT)) * knightPawn -
+             pos.count(make_piece(us, ROOK)) * rookPawn);
+  if (pos.count(make_piece(us, BISHOP)) >= 2)
+    s += bishopPair;
+  return s;
+}
+
+// Whether a side can force mate against a bare king
+inline bool can_mate(Position const &pos, Color c)
+{
+  int bishops = pos.count(make_piece(c, BISHOP));
+  return pos.count(make_piece(c, QUEEN)) || pos.count(make_piece(c, ROOK)) ||
+         bishops >= 2 || (bishops && pos.count(make_piece(c, KNIGHT)));
+}
+
+MaterialEntry const *material_entry(Position const &pos, MaterialEntry &local)
+{
+  Key k = pos.material_key();
+  MaterialEntry *e = &local;
+  if (MaterialTable *table = pos.material_table())
+  {
+    bool hit;
+    e = table->probe_local(k, hit);
+    if (hit)
+      return e;
+  }
+  e->key = k;
+  int nonPawn[NB_COLOR], pawns[NB_COLOR];
+  for (Color c : {WHITE, BLACK})
+  {
+    pawns[c] = pos.count(make_piece(c, PAWN));
+    nonPawn[c] = 0;
+    for (PieceType pt = KNIGHT; pt < KING; pt = PieceType(pt + 1))
+      nonPawn[c] += pieceValue[pt] * pos.count(make_piece(c, pt));
+  }
+  e->phase = nonPawn[WHITE] + nonPawn[BLACK] +
+             PawnValue * (pawns[WHITE] + pawns[BLACK]);
+  e->imbalance = imbalance<WHITE>(pos) - imbalance<BLACK>(pos);
+
+  e->endgame = Endgames::probe(k, e->strongSide);
+  for (Color c : {WHITE, BLACK})
+    if (!e->endgame && !nonPawn[!c] && !pawns[!c] && can_mate(pos, c))
+    {
+      e->endgame = Endgames::kxk;
+      e->strongSide = c;
+    }
+  if (!e->endgame && !pawns[WHITE] && !pawns[BLACK] &&
+      std::max(nonPawn[WHITE], nonPawn[BLACK]) <= pieceValue[BISHOP])
+  {
+    e->endgame = Endgames::draw;
+    e->strongSide = WHITE;
+  }
+  return e;
+}
+
+// Needs the attacks of both sides
+template <Color us>
+Score evaluate_king(Position const &pos, EvalInfo const &ei)
+{
+  constexpr Color them = !us;
+  Score s{0, 0};
+  Square ksq = pos.king_square(us);
+  File f = file_of(ksq);
+  for (File sf = std::max(FILE_A, File(f - 1)); sf <= std::min(FILE_H, File(f + 1));
+       ++sf)
+    if (!(pos.pieces(PAWN, us) & sf & passedPawnMaskBB[ksq][us]))
+      s += noShelter;
+
+  // A single attacker is only a threat with a queen
+  if (ei.kingAttackers[them] > 1 - popcount(pos.pieces(QUEEN, them)))
+  {
+    int danger =
+        ei.kingAttackers[them] * ei.kingAttackersWeight[them] +
+        69 * ei.kingAttacks[them] +
+        100 * popcount(ringBB[ksq] & ei.attacked[them] & ~ei.pawnAttacks[us]) -
+        600 * !pos.pieces(QUEEN, them);
+    danger = std::min(danger, 4000);
+    if (danger > 0)
+      s -= Score{Value(danger * danger / 4096), Value(danger / 16)};
+  }
+  return s;
+}
+} // namespace
+
+void Eval::init()
+{
+  for (PieceType pt = PAWN; pt <= KING; pt = PieceType(pt + 1))
+    for (Square sq = SQ_A1; sq <= SQ_H8; ++sq)
+    {
+      File f = file_of(sq);
+      Rank r = rank_of(sq);
+      Score s = Score{pieceValue[pt], pieceValueEg[pt]} +
+                (pt == PAWN ? pawnBonus[r][f]
+                            : pieceBonus[pt][r][std::min(f, File(FILE_H - f))]);
+      psqt[make_piece(WHITE, pt)][sq] = s;
+      psqt[make_piece(BLACK, pt)][Square(sq ^ 56)] = -s;
+    }
+}
+
+Value Eval::evaluate(Position const &pos)
+{
+  MaterialEntry localMaterial;
+  MaterialEntry const *me = material_entry(pos, localMaterial);
+  if (me->endgame)
+  {
+    Value v = me->endgame(pos, me->strongSide);
+    return pos.side_to_move() == me->strongSide ? v : Value(-v);
+  }
+
+  EvalInfo ei;
+  ei.pawnAttacks[WHITE] = pawn_attacks<WHITE>(pos.pieces(PAWN, WHITE));
+  ei.pawnAttacks[BLACK] = pawn_attacks<BLACK>(pos.pieces(PAWN, BLACK));
+  init_info<WHITE>(pos, ei);
+  init_info<BLACK>(pos, ei);
+
+  PawnEntry local;
+  PawnEntry const *pe = pawn_entry(pos, local);
+  Score s = pos.psq_score() + pe->score;
+  s += evaluate_passed<WHITE>(pos, *pe) - evaluate_passed<BLACK>(pos, *pe);
+  s += evaluate_pieces<WHITE, KNIGHT>(pos, ei) -
+       evaluate_pieces<BLACK, KNIGHT>(pos, ei);
+  s += evaluate_pieces<WHITE, BISHOP>(pos, ei) -
+       evaluate_pieces<BLACK, BISHOP>(pos, ei);
+  s += evaluate_pieces<WHITE, ROOK>(pos, ei) -
+       evaluate_pieces<BLACK, ROOK>(pos, ei);
+  s += evaluate_pieces<WHITE, QUEEN>(pos, ei) -
+       evaluate_pieces<BLACK, QUEEN>(pos, ei);
+  s += evaluate_king<WHITE>(pos, ei) - evaluate_king<BLACK>(pos, ei);
+
+  s += me->imbalance;
+  Value v = s.value(me->phase);
+  return Value((pos.side_to_move() == WHITE ? v : -v) + tempo);
+}
@@ -0,0 +1,62 @@
+#ifndef EVALUATE_INCLUDED
+#define EVALUATE_INCLUDED
+#include "endgame.hpp"
+#include "tt.hpp"
+#include "types.hpp"
+
+class Position;
+
+// Pawn structure of a position, which only depends on the pawn key. Scores are
+// from white's point of view, and a table has one entry per bucket : the
+// newest is always kept.
+struct PawnEntry
+{
+  inline bool match(Key k) const { return key == k; }
+  inline bool is_current(uint8_t) const { return true; }
+  inline void refresh(Key, uint8_t) {}
+  inline int priority(uint8_t) const { return 0; }
+
+  Key key;
+  Score score;
+  Bitboard passed[NB_COLOR];
+  Bitboard isolated[NB_COLOR];
+  Bitboard doubled[NB_COLOR];
+};
+using PawnTable = HashTable<PawnEntry>;
+// Per thread, 32768 entries
+constexpr size_t PAWN_TABLE_MB = 2;
+
+// What the material alone tells : the game phase, as the material of both
+// sides, the imbalance from white's point of view, and a specialized
+// evaluation for some endgames. Padded to a cache line, so that like the pawn
+// table a bucket holds a single entry, always replaced.
+struct alignas(64) MaterialEntry
+{
+  inline bool match(Key k) const { return key == k; }
+  inline bool is_current(uint8_t) const { return true; }
+  inline void refresh(Key, uint8_t) {}
+  inline int priority(uint8_t) const { return 0; }
+
+  Key key;
+  EndgameFn endgame; // nullptr for the general evaluation
+  Score imbalance;
+  int phase;
+  Color strongSide; // of the endgame
+};
+using MaterialTable = HashTable<MaterialEntry>;
+// Per thread, 32768 entries
+constexpr size_t MATERIAL_TABLE_MB = 2;
+
+// Hand-crafted evaluation, the fallback when no network is loaded
+namespace Eval
+{
+// Material and piece-square score of a piece on a square, from white's point
+// of view. Position keeps their sum up to date.
+extern Score psqt[NB_PIECE][NB_SQUARE];
+
+void init();
+// From the point of view of the side to move
+Value evaluate(Position const &pos);
+} // namespace Eval
+
+#endif
@@ -1,121 +1,358 @@
-#include "misc.hpp"
-#include "moves.hpp"
-#include "position.hpp"
-#include "tt.hpp"
-#include <chrono>
-#include <iostream>
-
-Key zobrist_stm;
-Key zobrist_sqp[NB_SQUARE][NB_PIECE];
-Key zobrist_ep[1 + NB_SQUARE];
-Key zobrist_castle[1 << NB_CASTLING];
-
-std::random_device rd;
-Gen gen;
-
-void zobrist_init()
-{
-  zobrist_stm = gen();
-  for (Key &key : zobrist_castle)
-    key = gen();
-  for (Key &key : zobrist_ep)
-    key = gen();
-  for (auto &tab : zobrist_sqp)
-    for (Key &key : tab)
-      key = gen();
-}
-namespace Perft
-{
-HashTable<PerftEntry> hash;
-
-uint64_t perft_search(Position &pos, Depth depth)
-{
-  static Moves moves[10];
-  bool hit;
-  uint64_t nodes = 0;
-  PerftEntry *pe = hash.probe(pos.get_key(), hit);
-  if (hit && pe->depth == depth)
-    return pe->perft;
-
-  moves[depth].set_pos(&pos);
-  if (depth == 1)
-    return moves[depth].size();
-
-  for (ValueMove m : moves[depth])
-  {
-    pos.do_move(m);
-    nodes += perft_search(pos, Depth(depth - 1));
-    pos.undo_move();
-  }
-  if (pe != nullptr)
-  {
-    pe->key = pos.get_key();
-    pe->perft = nodes;
-    pe->depth = Depth(depth);
-  }
-  return nodes;
-}
-
-void perft()
-{
-  constexpr size_t NB_POSITIONS = 19;
-  static const std::string position[NB_POSITIONS] = {
-      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
-      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
-      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
-      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
-      "1k6/1b6/8/8/7R/8/8/4K2R b K - 0 1",
-      "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
-      "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1",
-      "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
-      "5k2/8/8/8/8/8/8/4K2R w K - 0 1",
-      "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",
-      "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
-      "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
-      "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1",
-      "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1",
-      "4k3/1P6/8/8/8/8/K7/8 w - - 0 1",
-      "8/P1k5/K7/8/8/8/8/8 w - - 0 1",
-      "K1k5/8/P7/8/8/8/8/8 w - - 0 1",
-      "8/k1P5/8/1K6/8/8/8/8 w - - 0 1",
-      "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1"};
-  constexpr int depth[NB_POSITIONS] = {6, 5, 7, 6, 5, 6, 6, 6, 6, 6,
-                                       4, 4, 6, 5, 6, 6, 6, 7, 4};
-  constexpr uint64_t solution[NB_POSITIONS] = {
-      119060324, 193690690, 178633661, 706045033, 1063513, 1134888, 1015133,
-      1440467, 661072, 803711, 1274206, 1720476, 3821001, 1004658,
-      217342, 92683, 2217, 567584, 23527};
-  Position pos;
-  auto t0 = std::chrono::system_clock::now();
-  uint64_t total_nodes = 0;
-  hash.resize(16);
-  for (size_t i = 0; i < NB_POSITIONS; i++)
-  {
-    std::cout << Sync::lock << "Position " << i + 1 << '/' << NB_POSITIONS
-              << '\n'
-              << Sync::unlock;
-    pos.set_position(position[i]);
-    Moves moves(&pos);
-    uint64_t nodes = 0;
-    for (ValueMove m : moves)
-    {
-      pos.do_move(m);
-      uint64_t temp_nodes = perft_search(pos, Depth(depth[i] - 1));
-      nodes += temp_nodes;
-      pos.undo_move();
-    }
-    std::cout << Sync::lock << nodes << " nodes searched --> "
-              << (nodes == solution[i] ? "OK" : "FAIL") << "\n\n"
-              << Sync::unlock;
-    total_nodes += nodes;
-  }
-  auto t1 = std::chrono::system_clock::now();
-  float seconds =
-      (float)((t1 - t0).count() * std::chrono::system_clock::period::num) /
-      (float)std::chrono::system_clock::period::den;
-  std::cerr << "Time : " << seconds << " seconds"
-            << "\nNodes : " << total_nodes
-            << "\nNodes/second : " << (int)(total_nodes / seconds) << std::endl;
-  ;
-}
+#include "misc.hpp"
+#include "moves.hpp"
+#include "position.hpp"
+#include "threads.hpp"
+#include "tt.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+Key zobrist_stm;
+Key zobrist_sqp[NB_SQUARE][NB_PIECE];
+Key zobrist_ep[1 + NB_SQUARE];
+Key zobrist_castle[1 << NB_CASTLING];
+
+std::random_device rd;
+Gen gen;
+
+// The keys are drawn from a fixed seed so that searches, and thus the bench
+// node count, are reproducible across runs
+void zobrist_init()
+{
+  Gen gen{0x9e3779b97f4a7c15ULL};
+  zobrist_stm = gen();
+  for (Key &key : zobrist_castle)
+    key = gen();
+  for (Key &key : zobrist_ep)
+    key = gen();
+  for (auto &tab : zobrist_sqp)
+    for (Key &key : tab)
+      key = gen();
+}
+
+Key material_key(std::string const &strong, std::string const &weak,
+                 Color strongSide)
+{
+  Key k = 0;
+  int count[NB_PIECE] = {};
+  for (Color c : {strongSide, !strongSide})
+    for (char ch : c == strongSide ? strong : weak)
+    {
+      Piece p = make_piece(c, PieceType(pieceTypeStr.find(std::tolower(ch))));
+      k ^= zobrist_sqp[count[p]++][p];
+    }
+  return k;
+}
+
+namespace Perft
+{
+HashTable<PerftEntry> hash;
+
+uint64_t perft_search(Position &pos, Depth depth)
+{
+  if (depth == 1)
+    return pos.count_moves();
+
+  bool hit;
+  uint64_t nodes = 0;
+  PerftEntry entry;
+  PerftEntry *pe = hash.probe(pos.get_key(), entry, hit);
+  if (hit && entry.depth() == depth)
+    return entry.perft();
+
+  Moves moves(&pos);
+  for (ValueMove m : moves)
+  {
+    // Only children above depth 1 probe the table
+    if (depth > 2)
+      hash.prefetch(pos.key_after(m));
+    pos.do_move(m);
+    nodes += perft_search(pos, Depth(depth - 1));
+    pos.undo_move();
+  }
+  if (pe != nullptr)
+    pe->save(pos.get_key(), nodes, depth, hash.generation());
+  return nodes;
+}
+
+namespace
+{
+std::vector<Move> sorted_moves(ValueMove *begin, ValueMove *end)
+{
+  std::vector<Move> moves(begin, end);
+  std::sort(moves.begin(), moves.end());
+  return moves;
+}
+
+// Checks the staged generators against the legal one on every node of a tree :
+// the captures and the quiets, or the evasions in check, are the legal moves,
+// the quiet checks are the quiets giving check, and gives_check agrees with the
+// position after the move. Prints the first position failing.
+bool check_generators(Position &pos, Depth depth)
+{
+  ValueMove legal[MAX_MOVES], staged[MAX_MOVES], checks[MAX_MOVES];
+  ValueMove *endLegal = pos.generate_moves<LEGAL>(legal), *endStaged;
+  bool ok = true;
+  if (pos.in_check())
+    endStaged = pos.generate_moves<EVASIONS>(staged);
+  else
+  {
+    ValueMove *quiets = pos.generate_moves<CAPTURES>(staged);
+    endStaged = pos.generate_moves<QUIETS>(quiets);
+    std::vector<Move> quietChecks;
+    for (ValueMove *m = quiets; m != endStaged; ++m)
+      if (pos.gives_check(*m))
+        quietChecks.push_back(*m);
+    std::sort(quietChecks.begin(), quietChecks.end());
+    ok = quietChecks ==
+         sorted_moves(checks, pos.generate_moves<QUIET_CHECKS>(checks));
+  }
+  ok &= sorted_moves(legal, endLegal) == sorted_moves(staged, endStaged);
+  for (ValueMove *m = legal; ok && m != endLegal; ++m)
+  {
+    bool check = pos.gives_check(*m);
+    pos.do_move(*m);
+    ok = check == pos.in_check();
+    pos.undo_move();
+  }
+  if (!ok)
+  {
+    std::cout << Sync::lock << "Generators FAIL : " << pos.to_fen() << '\n'
+              << Sync::unlock;
+    return false;
+  }
+  for (ValueMove *m = legal; depth > 1 && m != endLegal; ++m)
+  {
+    pos.do_move(*m);
+    ok = check_generators(pos, Depth(depth - 1));
+    pos.undo_move();
+    if (!ok)
+      return false;
+  }
+  return true;
+}
+} // namespace
+
+// Perft of each root move, on nThreads threads of the pool. The tree is
+// split at the second ply and the subtrees are handed to the threads, which
+// play them on their own copy of the position and share the hash table.
+std::vector<std::pair<Move, uint64_t>> divide(Position const &root,
+                                              Depth depth, size_t nThreads)
+{
+  std::vector<std::pair<Move, uint64_t>> rootMoves;
+  std::vector<std::pair<size_t, Move>> frontier;
+  Position pos = root;
+  for (ValueMove m : Moves(&pos))
+  {
+    uint64_t nodes = 1;
+    pos.do_move(m);
+    if (depth == 2)
+      nodes = pos.count_moves();
+    else if (depth > 2)
+    {
+      nodes = 0;
+      for (ValueMove r : Moves(&pos))
+        frontier.emplace_back(rootMoves.size(), r);
+    }
+    pos.undo_move();
+    rootMoves.emplace_back(m, nodes);
+  }
+  if (frontier.empty())
+    return rootMoves;
+
+  std::atomic<size_t> next(0);
+  std::vector<std::atomic<uint64_t>> nodes(rootMoves.size());
+  Threads.run_on_all([&](size_t idx) {
+    if (idx >= nThreads)
+      return;
+    Position p = root;
+    for (size_t i = next++; i < frontier.size(); i = next++)
+    {
+      p.do_move(rootMoves[frontier[i].first].first);
+      p.do_move(frontier[i].second);
+      nodes[frontier[i].first] += perft_search(p, Depth(depth - 2));
+      p.undo_move();
+      p.undo_move();
+    }
+  });
+  for (size_t i = 0; i < rootMoves.size(); ++i)
+    rootMoves[i].second = nodes[i];
+  return rootMoves;
+}
+
+uint64_t parallel_perft(Position const &root, Depth depth)
+{
+  uint64_t nodes = 0;
+  for (auto const &rm : divide(root, depth, Threads.size()))
+    nodes += rm.second;
+  return nodes;
+}
+
+void perft_divide(Position const &pos, Depth depth, size_t hashMB, size_t nThreads)
+{
+  hash.resize(hashMB);
+  Position root = pos;
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t total_nodes = 0;
+  for (auto const &rm : divide(root, depth, nThreads))
+  {
+    std::cout << Sync::lock << (MovePrint)rm.first << ": " << rm.second << '\n'
+              << Sync::unlock;
+    total_nodes += rm.second;
+  }
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - t0)
+                .count();
+  std::cout << Sync::lock << "\nNodes searched: " << total_nodes
+            << "\nTime (ms): " << ms
+            << "\nNodes/second: " << total_nodes * 1000 / std::max<int64_t>(ms, 1) << '\n'
+            << std::endl
+            << Sync::unlock;
+}
+
+bool perft()
+{
+  constexpr size_t NB_POSITIONS = 19;
+  static const std::string position[NB_POSITIONS] = {
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "1k6/1b6/8/8/7R/8/8/4K2R b K - 0 1",
+      "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
+      "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1",
+      "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+      "5k2/8/8/8/8/8/8/4K2R w K - 0 1",
+      "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",
+      "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+      "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
+      "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1",
+      "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1",
+      "4k3/1P6/8/8/8/8/K7/8 w - - 0 1",
+      "8/P1k5/K7/8/8/8/8/8 w - - 0 1",
+      "K1k5/8/P7/8/8/8/8/8 w - - 0 1",
+      "8/k1P5/8/1K6/8/8/8/8 w - - 0 1",
+      "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1"};
+  constexpr int depth[NB_POSITIONS] = {6, 5, 7, 6, 5, 6, 6, 6, 6, 6,
+                                       4, 4, 6, 5, 6, 6, 6, 7, 4};
+  constexpr int GENERATORS_DEPTH = 3;
+  constexpr uint64_t solution[NB_POSITIONS] = {
+      119060324, 193690690, 178633661, 706045033, 1063513, 1134888, 1015133,
+      1440467, 661072, 803711, 1274206, 1720476, 3821001, 1004658,
+      217342, 92683, 2217, 567584, 23527};
+  Position pos;
+  auto t0 = std::chrono::system_clock::now();
+  uint64_t total_nodes = 0;
+  bool ok = true;
+  hash.resize(16);
+  for (size_t i = 0; i < NB_POSITIONS; i++)
+  {
+    std::cout << Sync::lock << "Position " << i + 1 << '/' << NB_POSITIONS
+              << '\n'
+              << Sync::unlock;
+    pos.set_position(position[i]);
+    hash.new_search();
+    uint64_t nodes = parallel_perft(pos, Depth(depth[i]));
+    std::cout << Sync::lock << nodes << " nodes searched --> "
+              << (nodes == solution[i] ? "OK" : "FAIL") << "\n\n"
+              << Sync::unlock;
+    total_nodes += nodes;
+    ok &= nodes == solution[i];
+    ok &= check_generators(pos, Depth(std::min(depth[i], GENERATORS_DEPTH)));
+  }
+  auto t1 = std::chrono::system_clock::now();
+  float seconds =
+      (float)((t1 - t0).count() * std::chrono::system_clock::period::num) /
+      (float)std::chrono::system_clock::period::den;
+  std::cerr << "Time : " << seconds << " seconds"
+            << "\nNodes : " << total_nodes
+            << "\nNodes/second : " << (uint64_t)(total_nodes / seconds)
+            << std::endl;
+  return ok;
+}
+
+// Checks every depth of an EPD line : "fen ;D1 20 ;D2 400 ...". Returns false
+// if one count is wrong.
+bool perft_epd_line(Position &pos, std::string const &line, size_t lineNb,
+                    uint64_t &nodes)
+{
+  size_t sep = line.find(';');
+  pos.set_position(line.substr(0, sep));
+  std::istringstream is(sep == std::string::npos ? "" : line.substr(sep));
+  char c;
+  int depth;
+  uint64_t expected;
+  bool ok = true;
+  while (is >> c >> c >> depth >> expected)
+  {
+    uint64_t count = depth > 0 ? perft_search(pos, Depth(depth)) : 1;
+    nodes += count;
+    if (count != expected)
+    {
+      std::cout << Sync::lock << "FAIL line " << lineNb << " depth " << depth
+                << " : " << count << " nodes, expected " << expected << '\n'
+                << line << '\n'
+                << Sync::unlock;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool perft(std::string const &file)
+{
+  std::ifstream epd(file);
+  if (!epd)
+  {
+    std::cerr << "Cannot open " << file << std::endl;
+    return false;
+  }
+  hash.resize(16);
+  hash.new_search();
+
+  // The lines are read by the threads as they need them, so that suites of
+  // any size are streamed. Each thread runs its positions single threaded.
+  std::mutex m;
+  size_t lines = 0;
+  std::atomic<size_t> positions(0), failed(0);
+  std::atomic<uint64_t> total_nodes(0);
+  auto t0 = std::chrono::steady_clock::now();
+  Threads.run_on_all([&](size_t) {
+    Position pos;
+    std::string line;
+    uint64_t nodes = 0;
+    while (true)
+    {
+      size_t lineNb;
+      {
+        std::lock_guard<std::mutex> lock(m);
+        if (!std::getline(epd, line))
+          break;
+        lineNb = ++lines;
+      }
+      size_t start = line.find_first_not_of(" \t\r");
+      if (start == std::string::npos)
+        continue;
+      ++positions;
+      if (!perft_epd_line(pos, line.substr(start), lineNb, nodes))
+        ++failed;
+    }
+    total_nodes += nodes;
+  });
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - t0)
+                .count();
+  std::cout << Sync::lock << "\nPositions : " << positions
+            << "\nPassed : " << positions - failed << "\nFailed : " << failed
+            << "\nNodes : " << total_nodes << "\nTime (ms) : " << ms
+            << "\nNodes/second : "
+            << total_nodes * 1000 / std::max<int64_t>(ms, 1) << std::endl
+            << Sync::unlock;
+  return !failed;
+}
 } // namespace Perft
\ No newline at end of file
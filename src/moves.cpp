@@ -1,180 +1,766 @@
-#include "bitboards.hpp"
-#include "misc.hpp"
-#include "position.hpp"
-#include "types.hpp"
-
-template <PieceType pt, Color c>
-ValueMove *Position::generate_moves(ValueMove *moveList,
-                                    Bitboard target) const
-{
-  constexpr Piece p = make_piece(c, pt);
-  for (const Square *sq = pieceList[p]; sq != pieceList[p] + nbPiece[p]; ++sq)
-  {
-    Bitboard b = is_pinned(*sq)
-                     ? attacks_from<pt>(*sq) & target & lineBB[our_king()][*sq]
-                     : attacks_from<pt>(*sq) & target;
-    while (b)
-      *moveList++ = make_move<NORMAL>(*sq, pop_lsb(b));
-  }
-  return moveList;
-}
-
-template <Color c>
-ValueMove *Position::generate_pawn_moves(ValueMove *moveList,
-                                         Bitboard target) const
-{
-  constexpr Direction up = c ? SOUTH : NORTH;
-  constexpr Piece p = make_piece(c, PAWN);
-  for (const Square *sq = pieceList[p]; sq != pieceList[p] + nbPiece[p]; ++sq)
-  {
-    bool pinned = is_pinned(*sq);
-    // Generating captures
-    Bitboard b = pinned ? attacks_from<PAWN>(*sq, c) & pieces(!c) &
-                              lineBB[our_king()][*sq] & target
-                        : attacks_from<PAWN>(*sq, c) & pieces(!c) & target;
-    if (b & promotionRankBB)
-      while (b)
-      {
-        Square to = pop_lsb(b);
-        *moveList++ = make_move<PROMOTION>(*sq, to, QUEEN);
-        *moveList++ = make_move<PROMOTION>(*sq, to, KNIGHT);
-        *moveList++ = make_move<PROMOTION>(*sq, to, ROOK);
-        *moveList++ = make_move<PROMOTION>(*sq, to, BISHOP);
-      }
-    else
-      while (b)
-        *moveList++ = make_move<NORMAL>(*sq, pop_lsb(b));
-
-    // Generating pawn pushes and quiet promotions
-    Square to = *sq + up;
-    if (!piece(to) && (!pinned || file_of(*sq) == file_of(our_king())))
-    {
-      if (target & to)
-      {
-        if (rank_of(to) != (c ? RANK_1 : RANK_8))
-          *moveList++ = make_move<NORMAL>(*sq, to);
-        else
-        {
-          *moveList++ = make_move<PROMOTION>(*sq, to, QUEEN);
-          *moveList++ = make_move<PROMOTION>(*sq, to, KNIGHT);
-          *moveList++ = make_move<PROMOTION>(*sq, to, ROOK);
-          *moveList++ = make_move<PROMOTION>(*sq, to, BISHOP);
-        }
-      }
-      if (rank_of(*sq) == (c ? RANK_7 : RANK_2) && !piece(to + up) &&
-          (target & (to + up)))
-        *moveList++ = make_move<NORMAL>(*sq, to + up);
-    }
-  }
-  // Generating en passant capture
-  if (state->epSquare != NO_SQUARE &&
-      target & (bb_of(state->epSquare) | (state->epSquare + down(c))))
-  {
-    Square ksq = our_king();
-    Bitboard b = pieces(PAWN, c) & pawnPseudoAttack[state->epSquare][!c];
-    while (b)
-    {
-      Square from = pop_lsb(b);
-      if ((!is_pinned(from) || lineBB[from][ksq] & state->epSquare) &&
-          rank_of(from) != rank_of(ksq))
-        *moveList++ = make_move<EN_PASSANT>(from, state->epSquare);
-      else if (rank_of(from) == rank_of(ksq))
-      {
-        Square takenPawn = state->epSquare + down(c);
-        Square closerToKing, furtherFromKing;
-        if (betweenBB[ksq][from] & takenPawn)
-        {
-          closerToKing = takenPawn;
-          furtherFromKing = from;
-        }
-        else
-        {
-          closerToKing = from;
-          furtherFromKing = takenPawn;
-        }
-        if (pieces() & betweenBB[ksq][closerToKing] ||
-            !(attacks_from<ROOK>(furtherFromKing) & pieces(!c) &
-              pieces(ROOK, QUEEN) & lineBB[ksq][furtherFromKing]))
-          *moveList++ = make_move<EN_PASSANT>(from, state->epSquare);
-      }
-    }
-  }
-  return moveList;
-}
-
-template <Color c>
-ValueMove *Position::generate_king_moves(ValueMove *moveList,
-                                         Bitboard target) const
-{
-  Square from = our_king();
-  Bitboard b = attacks_from<KING>(from) & target;
-  // normal moves
-  while (b)
-  {
-    Square sq = pop_lsb(b);
-    if (!(attacks_to(sq) & pieces(!c)))
-      *moveList++ = make_move<NORMAL>(from, sq);
-  }
-  // castling
-  int cstlrights = state->castlingRights;
-  if (cstlrights && !state->checkers)
-  {
-    if constexpr (c)
-    {
-      if ((cstlrights & B_OO) && !(betweenBB[SQ_E8][SQ_H8] & pieces()) &&
-          !((attacks_to(SQ_F8) | attacks_to(SQ_G8)) & pieces(WHITE)))
-        *moveList++ = cstl_move[2];
-      if ((cstlrights & B_OOO) && !(betweenBB[SQ_E8][SQ_A8] & pieces()) &&
-          !((attacks_to(SQ_C8) | attacks_to(SQ_D8)) & pieces(WHITE)))
-        *moveList++ = cstl_move[3];
-    }
-    else
-    {
-      if ((cstlrights & W_OO) && !(betweenBB[SQ_E1][SQ_H1] & pieces()) &&
-          !((attacks_to(SQ_F1) | attacks_to(SQ_G1)) & pieces(BLACK)))
-        *moveList++ = cstl_move[0];
-      if ((cstlrights & W_OOO) && !(betweenBB[SQ_E1][SQ_A1] & pieces()) &&
-          !((attacks_to(SQ_C1) | attacks_to(SQ_D1)) & pieces(BLACK)))
-        *moveList++ = cstl_move[1];
-    }
-  }
-  return moveList;
-}
-
-ValueMove *Position::generate_moves(ValueMove *moveList) const
-{
-  Bitboard target = ~pieces(stm);
-  Bitboard ktarget = target;
-  Bitboard checkers = state->checkers;
-  while (checkers)
-  {
-    Square checker = pop_lsb(checkers);
-    if (piece_type_of(piece(checker)) != PAWN)
-      ktarget &= ~lineBB[our_king()][checker] | checker;
-    target &= betweenBB[our_king()][checker] | checker;
-  }
-  if (stm)
-  {
-    if (target)
-    {
-      moveList = generate_pawn_moves<BLACK>(moveList, target);
-      moveList = generate_moves<KNIGHT, BLACK>(moveList, target);
-      moveList = generate_moves<BISHOP, BLACK>(moveList, target);
-      moveList = generate_moves<ROOK, BLACK>(moveList, target);
-      moveList = generate_moves<QUEEN, BLACK>(moveList, target);
-    }
-    return generate_king_moves<BLACK>(moveList, ktarget);
-  }
-  else
-  {
-    if (target)
-    {
-      moveList = generate_pawn_moves<WHITE>(moveList, target);
-      moveList = generate_moves<KNIGHT, WHITE>(moveList, target);
-      moveList = generate_moves<BISHOP, WHITE>(moveList, target);
-      moveList = generate_moves<ROOK, WHITE>(moveList, target);
-      moveList = generate_moves<QUEEN, WHITE>(moveList, target);
-    }
-    return generate_king_moves<WHITE>(moveList, ktarget);
-  }
-}
\ No newline at end of file
+#include "bitboards.hpp"
+#include "misc.hpp"
+#include "moves.hpp"
+#include "position.hpp"
+#include "types.hpp"
+
+template <PieceType pt, Color c>
+ValueMove *Position::generate_piece_moves(ValueMove *moveList,
+                                          Bitboard target) const
+{
+  constexpr Piece p = make_piece(c, pt);
+  for (const Square *sq = pieceList[p]; sq != pieceList[p] + nbPiece[p]; ++sq)
+  {
+    Bitboard b = is_pinned(*sq)
+                     ? attacks_from<pt>(*sq) & target & lineBB[our_king()][*sq]
+                     : attacks_from<pt>(*sq) & target;
+    while (b)
+      *moveList++ = make_move<NORMAL>(*sq, pop_lsb(b));
+  }
+  return moveList;
+}
+
+// Queen promotions go with the captures, underpromotions with the quiets
+template <GenType gt>
+inline ValueMove *make_promotions(ValueMove *moveList, Square from, Square to)
+{
+  if (gt != QUIETS)
+    *moveList++ = make_move<PROMOTION>(from, to, QUEEN);
+  if (gt != CAPTURES)
+  {
+    *moveList++ = make_move<PROMOTION>(from, to, KNIGHT);
+    *moveList++ = make_move<PROMOTION>(from, to, ROOK);
+    *moveList++ = make_move<PROMOTION>(from, to, BISHOP);
+  }
+  return moveList;
+}
+
+template <Color c, GenType gt>
+ValueMove *Position::generate_pawn_moves(ValueMove *moveList,
+                                         Bitboard target) const
+{
+  constexpr Direction up = c ? SOUTH : NORTH;
+  constexpr Piece p = make_piece(c, PAWN);
+  for (const Square *sq = pieceList[p]; sq != pieceList[p] + nbPiece[p]; ++sq)
+  {
+    bool pinned = is_pinned(*sq);
+    // Generating captures
+    Bitboard b = pinned ? attacks_from<PAWN>(*sq, c) & pieces(!c) &
+                              lineBB[our_king()][*sq] & target
+                        : attacks_from<PAWN>(*sq, c) & pieces(!c) & target;
+    if (b & promotionRankBB)
+      while (b)
+        moveList = make_promotions<gt>(moveList, *sq, pop_lsb(b));
+    else if (gt != QUIETS)
+      while (b)
+        *moveList++ = make_move<NORMAL>(*sq, pop_lsb(b));
+
+    // Generating pawn pushes and quiet promotions
+    Square to = *sq + up;
+    if (!piece(to) && (!pinned || file_of(*sq) == file_of(our_king())))
+    {
+      if (target & to)
+      {
+        if (rank_of(to) == (c ? RANK_1 : RANK_8))
+          moveList = make_promotions<gt>(moveList, *sq, to);
+        else if (gt != CAPTURES)
+          *moveList++ = make_move<NORMAL>(*sq, to);
+      }
+      if (gt != CAPTURES && rank_of(*sq) == (c ? RANK_7 : RANK_2) &&
+          !piece(to + up) && (target & (to + up)))
+        *moveList++ = make_move<NORMAL>(*sq, to + up);
+    }
+  }
+  // Generating en passant capture
+  if (gt != QUIETS)
+  {
+    Bitboard b = en_passant_pawns<c>(target);
+    while (b)
+      *moveList++ = make_move<EN_PASSANT>(pop_lsb(b), state->epSquare);
+  }
+  return moveList;
+}
+
+// Pawns that can legally capture en passant
+template <Color c>
+Bitboard Position::en_passant_pawns(Bitboard target) const
+{
+  Bitboard legal = 0;
+  if (state->epSquare == NO_SQUARE ||
+      !(target & (bb_of(state->epSquare) | (state->epSquare + down(c)))))
+    return legal;
+  Square ksq = our_king();
+  Bitboard b = pieces(PAWN, c) & pawnPseudoAttack[state->epSquare][!c];
+  while (b)
+  {
+    Square from = pop_lsb(b);
+    if ((!is_pinned(from) || lineBB[from][ksq] & state->epSquare) &&
+        rank_of(from) != rank_of(ksq))
+      legal |= from;
+    else if (rank_of(from) == rank_of(ksq))
+    {
+      Square takenPawn = state->epSquare + down(c);
+      Square closerToKing, furtherFromKing;
+      if (betweenBB[ksq][from] & takenPawn)
+      {
+        closerToKing = takenPawn;
+        furtherFromKing = from;
+      }
+      else
+      {
+        closerToKing = from;
+        furtherFromKing = takenPawn;
+      }
+      if (pieces() & betweenBB[ksq][closerToKing] ||
+          !(attacks_from<ROOK>(furtherFromKing) & pieces(!c) &
+            pieces(ROOK, QUEEN) & lineBB[ksq][furtherFromKing]))
+        legal |= from;
+    }
+  }
+  return legal;
+}
+
+// Legal castlings, as a set of Castling flags
+template <Color c>
+unsigned Position::legal_castlings() const
+{
+  unsigned cstlrights = state->castlingRights, legal = NO_CASTLING;
+  if (!cstlrights || state->checkers)
+    return legal;
+  if constexpr (c)
+  {
+    if ((cstlrights & B_OO) && !(betweenBB[SQ_E8][SQ_H8] & pieces()) &&
+        !((attacks_to(SQ_F8) | attacks_to(SQ_G8)) & pieces(WHITE)))
+      legal |= B_OO;
+    if ((cstlrights & B_OOO) && !(betweenBB[SQ_E8][SQ_A8] & pieces()) &&
+        !((attacks_to(SQ_C8) | attacks_to(SQ_D8)) & pieces(WHITE)))
+      legal |= B_OOO;
+  }
+  else
+  {
+    if ((cstlrights & W_OO) && !(betweenBB[SQ_E1][SQ_H1] & pieces()) &&
+        !((attacks_to(SQ_F1) | attacks_to(SQ_G1)) & pieces(BLACK)))
+      legal |= W_OO;
+    if ((cstlrights & W_OOO) && !(betweenBB[SQ_E1][SQ_A1] & pieces()) &&
+        !((attacks_to(SQ_C1) | attacks_to(SQ_D1)) & pieces(BLACK)))
+      legal |= W_OOO;
+  }
+  return legal;
+}
+
+template <Color c, GenType gt>
+ValueMove *Position::generate_king_moves(ValueMove *moveList,
+                                         Bitboard target) const
+{
+  Square from = our_king();
+  Bitboard b = attacks_from<KING>(from) & target;
+  // normal moves
+  while (b)
+  {
+    Square sq = pop_lsb(b);
+    if (!(attacks_to(sq) & pieces(!c)))
+      *moveList++ = make_move<NORMAL>(from, sq);
+  }
+  // castling
+  if (gt != CAPTURES && gt != EVASIONS)
+  {
+    unsigned castlings = legal_castlings<c>();
+    while (castlings)
+    {
+      *moveList++ = cstl_move[ctz(castlings)];
+      castlings &= castlings - 1;
+    }
+  }
+  return moveList;
+}
+
+// Destination squares of the king, and of the other pieces which must block
+// or capture the checkers
+void Position::legal_targets(Bitboard &target, Bitboard &ktarget) const
+{
+  target = ~pieces(stm);
+  ktarget = target;
+  Bitboard checkers = state->checkers;
+  while (checkers)
+  {
+    Square checker = pop_lsb(checkers);
+    if (piece_type_of(piece(checker)) != PAWN)
+      ktarget &= ~lineBB[our_king()][checker] | checker;
+    target &= betweenBB[our_king()][checker] | checker;
+  }
+}
+
+// Squares from which a piece of the side to move would check their king
+Bitboard Position::check_squares(PieceType pt) const
+{
+  Square ksq = their_king();
+  switch (pt)
+  {
+  case PAWN:
+    return pawnPseudoAttack[ksq][!stm];
+  case KNIGHT:
+    return knightPseudoAttacks[ksq];
+  case BISHOP:
+    return attacks_from<BISHOP>(ksq);
+  case ROOK:
+    return attacks_from<ROOK>(ksq);
+  case QUEEN:
+    return attacks_from<QUEEN>(ksq);
+  default:
+    return 0;
+  }
+}
+
+// Direct checks, and any move of a piece uncovering a check
+template <PieceType pt, Color c>
+ValueMove *Position::generate_piece_checks(ValueMove *moveList,
+                                           Bitboard target) const
+{
+  constexpr Piece p = make_piece(c, pt);
+  Bitboard checkSquares = check_squares(pt);
+  Bitboard discoverers = state->blockers[!c];
+  for (const Square *sq = pieceList[p]; sq != pieceList[p] + nbPiece[p]; ++sq)
+  {
+    Bitboard b = attacks_from<pt>(*sq) & target &
+                 (discoverers & *sq ? checkSquares | ~lineBB[their_king()][*sq]
+                                    : checkSquares);
+    if (is_pinned(*sq))
+      b &= lineBB[our_king()][*sq];
+    while (b)
+      *moveList++ = make_move<NORMAL>(*sq, pop_lsb(b));
+  }
+  return moveList;
+}
+
+template <Color c>
+ValueMove *Position::generate_quiet_checks(ValueMove *moveList) const
+{
+  constexpr Direction up = c ? SOUTH : NORTH;
+  constexpr Piece p = make_piece(c, PAWN);
+  Square ksq = their_king();
+  Bitboard empty = ~pieces();
+  Bitboard discoverers = state->blockers[!c];
+  Bitboard checkSquares = check_squares(PAWN);
+
+  for (const Square *sq = pieceList[p]; sq != pieceList[p] + nbPiece[p]; ++sq)
+  {
+    Square to = *sq + up;
+    if (piece(to) || (is_pinned(*sq) && file_of(*sq) != file_of(our_king())))
+      continue;
+    Bitboard checks = discoverers & *sq ? checkSquares | ~lineBB[ksq][*sq]
+                                        : checkSquares;
+    if (rank_of(to) == (c ? RANK_1 : RANK_8))
+    {
+      // Underpromotions, rare enough to be tested one by one
+      for (PieceType pt : {KNIGHT, ROOK, BISHOP})
+        if (gives_check(make_move<PROMOTION>(*sq, to, pt)))
+          *moveList++ = make_move<PROMOTION>(*sq, to, pt);
+      continue;
+    }
+    if (checks & to)
+      *moveList++ = make_move<NORMAL>(*sq, to);
+    if (rank_of(*sq) == (c ? RANK_7 : RANK_2) && !piece(to + up) &&
+        (checks & (to + up)))
+      *moveList++ = make_move<NORMAL>(*sq, to + up);
+  }
+  // Capturing underpromotions belong to the quiets as well
+  Bitboard promoting = pieces(PAWN, c) & (c ? RANK_2_BB : RANK_7_BB);
+  while (promoting)
+  {
+    Square from = pop_lsb(promoting);
+    Bitboard b = attacks_from<PAWN>(from, c) & pieces(!c);
+    if (is_pinned(from))
+      b &= lineBB[our_king()][from];
+    while (b)
+    {
+      Square to = pop_lsb(b);
+      for (PieceType pt : {KNIGHT, ROOK, BISHOP})
+        if (gives_check(make_move<PROMOTION>(from, to, pt)))
+          *moveList++ = make_move<PROMOTION>(from, to, pt);
+    }
+  }
+
+  moveList = generate_piece_checks<KNIGHT, c>(moveList, empty);
+  moveList = generate_piece_checks<BISHOP, c>(moveList, empty);
+  moveList = generate_piece_checks<ROOK, c>(moveList, empty);
+  moveList = generate_piece_checks<QUEEN, c>(moveList, empty);
+
+  // The king only checks by uncovering, or by castling
+  Square from = our_king();
+  if (discoverers & from)
+  {
+    Bitboard b = attacks_from<KING>(from) & empty & ~lineBB[ksq][from];
+    while (b)
+    {
+      Square to = pop_lsb(b);
+      if (!(attacks_to(to) & pieces(!c)))
+        *moveList++ = make_move<NORMAL>(from, to);
+    }
+  }
+  unsigned castlings = legal_castlings<c>();
+  while (castlings)
+  {
+    Move m = cstl_move[ctz(castlings)];
+    if (gives_check(m))
+      *moveList++ = m;
+    castlings &= castlings - 1;
+  }
+  return moveList;
+}
+
+// King moves off the lines of the sliding checkers, and with a single checker
+// the moves capturing it or blocking its line
+template <Color c>
+ValueMove *Position::generate_evasions(ValueMove *moveList) const
+{
+  Square ksq = our_king();
+  Bitboard checkers = state->checkers;
+  Bitboard ktarget = ~pieces(c);
+  Bitboard sliders = checkers & ~pieces(PAWN, KNIGHT);
+  while (sliders)
+  {
+    Square checker = pop_lsb(sliders);
+    ktarget &= ~lineBB[ksq][checker] | checker;
+  }
+  moveList = generate_king_moves<c, EVASIONS>(moveList, ktarget);
+  // In double check, only the king can move
+  if (more_than_one(checkers))
+    return moveList;
+
+  Square checker = Square(ctz(checkers));
+  Bitboard target = betweenBB[ksq][checker] | checker;
+  moveList = generate_pawn_moves<c, EVASIONS>(moveList, target);
+  moveList = generate_piece_moves<KNIGHT, c>(moveList, target);
+  moveList = generate_piece_moves<BISHOP, c>(moveList, target);
+  moveList = generate_piece_moves<ROOK, c>(moveList, target);
+  return generate_piece_moves<QUEEN, c>(moveList, target);
+}
+
+template <Color c, GenType gt>
+ValueMove *Position::generate_moves(ValueMove *moveList) const
+{
+  if constexpr (gt == QUIET_CHECKS)
+  {
+    assert(!in_check());
+    return generate_quiet_checks<c>(moveList);
+  }
+  if constexpr (gt == EVASIONS)
+  {
+    assert(in_check());
+    return generate_evasions<c>(moveList);
+  }
+  Bitboard target, ktarget;
+  legal_targets(target, ktarget);
+  // Promotions are sorted by the pawn generator
+  Bitboard ptarget = target;
+  if (gt == CAPTURES)
+  {
+    target &= pieces(!c);
+    ktarget &= pieces(!c);
+  }
+  else if (gt == QUIETS)
+  {
+    target &= ~pieces();
+    ktarget &= ~pieces();
+  }
+  if (ptarget)
+  {
+    moveList = generate_pawn_moves<c, gt>(moveList, ptarget);
+    moveList = generate_piece_moves<KNIGHT, c>(moveList, target);
+    moveList = generate_piece_moves<BISHOP, c>(moveList, target);
+    moveList = generate_piece_moves<ROOK, c>(moveList, target);
+    moveList = generate_piece_moves<QUEEN, c>(moveList, target);
+  }
+  return generate_king_moves<c, gt>(moveList, ktarget);
+}
+
+template <GenType gt>
+ValueMove *Position::generate_moves(ValueMove *moveList) const
+{
+  return stm ? generate_moves<BLACK, gt>(moveList)
+             : generate_moves<WHITE, gt>(moveList);
+}
+
+template ValueMove *Position::generate_moves<CAPTURES>(ValueMove *) const;
+template ValueMove *Position::generate_moves<QUIETS>(ValueMove *) const;
+template ValueMove *Position::generate_moves<QUIET_CHECKS>(ValueMove *) const;
+template ValueMove *Position::generate_moves<EVASIONS>(ValueMove *) const;
+template ValueMove *Position::generate_moves<LEGAL>(ValueMove *) const;
+
+// Counting legal moves without generating them, for perft leaves. Uses the
+// same targets as generate_moves, counting promotions four times.
+template <Color c>
+int Position::count_moves(Bitboard target, Bitboard ktarget) const
+{
+  constexpr Direction up = c ? SOUTH : NORTH;
+  constexpr Direction upEast = c ? SOUTH_EAST : NORTH_EAST;
+  constexpr Direction upWest = c ? SOUTH_WEST : NORTH_WEST;
+  constexpr Bitboard doublePushRank = c ? RANK_6_BB : RANK_3_BB;
+  auto count_pawn = [](Bitboard b) {
+    return popcount(b & ~promotionRankBB) + 4 * popcount(b & promotionRankBB);
+  };
+  int count = 0;
+
+  if (target)
+  {
+    // Pawns which are not pinned, set-wise
+    Bitboard pawns = pieces(PAWN, c) & ~state->blockers[c];
+    Bitboard push = shift<up>(pawns) & ~pieces();
+    count += count_pawn(push & target);
+    count += popcount(shift<up>(push & doublePushRank) & ~pieces() & target);
+    count += count_pawn(shift<upEast>(pawns) & pieces(!c) & target);
+    count += count_pawn(shift<upWest>(pawns) & pieces(!c) & target);
+
+    // Pinned pawns can only move along the pin
+    pawns = pieces(PAWN, c) & state->blockers[c];
+    while (pawns)
+    {
+      Square sq = pop_lsb(pawns);
+      Bitboard pin = lineBB[our_king()][sq];
+      count += count_pawn(attacks_from<PAWN>(sq, c) & pieces(!c) & pin & target);
+      Square to = sq + up;
+      if (!piece(to) && (pin & to))
+      {
+        count += count_pawn(target & to);
+        if (rank_of(sq) == (c ? RANK_7 : RANK_2) && !piece(to + up) &&
+            (target & (to + up)))
+          ++count;
+      }
+    }
+    count += popcount(en_passant_pawns<c>(target));
+
+    count += count_piece_moves<KNIGHT, c>(target);
+    count += count_piece_moves<BISHOP, c>(target);
+    count += count_piece_moves<ROOK, c>(target);
+    count += count_piece_moves<QUEEN, c>(target);
+  }
+
+  Square ksq = our_king();
+  Bitboard b = attacks_from<KING>(ksq) & ktarget;
+  while (b)
+    if (!(attacks_to(pop_lsb(b)) & pieces(!c)))
+      ++count;
+  return count + popcount(legal_castlings<c>());
+}
+
+template <PieceType pt, Color c>
+int Position::count_piece_moves(Bitboard target) const
+{
+  constexpr Piece p = make_piece(c, pt);
+  int count = 0;
+  for (const Square *sq = pieceList[p]; sq != pieceList[p] + nbPiece[p]; ++sq)
+    count += is_pinned(*sq) ? popcount(attacks_from<pt>(*sq) & target &
+                                       lineBB[our_king()][*sq])
+                            : popcount(attacks_from<pt>(*sq) & target);
+  return count;
+}
+
+int Position::count_moves() const
+{
+  Bitboard target, ktarget;
+  legal_targets(target, ktarget);
+  return stm ? count_moves<BLACK>(target, ktarget)
+             : count_moves<WHITE>(target, ktarget);
+}
+
+// Whether a move which was not generated here, from the hash table or a
+// killer, is legal. Agrees with generate_moves.
+bool Position::is_legal(Move m) const
+{
+  Square from = get_from(m), to = get_to(m);
+  Piece pc = piece(from);
+  if (m == NO_MOVE || pc == NO_PIECE || color_of(pc) != stm)
+    return false;
+  MoveType mt = get_move_type(m);
+  if (mt == CASTLING)
+  {
+    unsigned castlings = stm ? legal_castlings<BLACK>() : legal_castlings<WHITE>();
+    for (size_t i = 0; i < NB_CASTLING; ++i)
+      if ((castlings & (1 << i)) && cstl_move[i] == m)
+        return true;
+    return false;
+  }
+  Bitboard target, ktarget;
+  legal_targets(target, ktarget);
+  if (mt == EN_PASSANT)
+    return to == state->epSquare && m == make_move<EN_PASSANT>(from, to) &&
+           ((stm ? en_passant_pawns<BLACK>(target)
+                 : en_passant_pawns<WHITE>(target)) &
+            from);
+
+  PieceType pt = piece_type_of(pc);
+  if (mt == NORMAL && m != make_move<NORMAL>(from, to))
+    return false;
+  if ((mt == PROMOTION) !=
+      (pt == PAWN && rank_of(to) == (stm ? RANK_1 : RANK_8)))
+    return false;
+  if (pt == KING)
+    return (attacks_from<KING>(from) & ktarget & to) &&
+           !(attacks_to(to) & pieces(!stm));
+  if (!(target & to) || (is_pinned(from) && !(lineBB[our_king()][from] & to)))
+    return false;
+  switch (pt)
+  {
+  case PAWN:
+  {
+    if (attacks_from<PAWN>(from, stm) & pieces(!stm) & to)
+      return true;
+    Square push = from + up(stm);
+    return !piece(push) &&
+           (to == push || (to == push + up(stm) && !piece(to) &&
+                           rank_of(from) == (stm ? RANK_7 : RANK_2)));
+  }
+  case KNIGHT:
+    return attacks_from<KNIGHT>(from) & to;
+  case BISHOP:
+    return attacks_from<BISHOP>(from) & to;
+  case ROOK:
+    return attacks_from<ROOK>(from) & to;
+  case QUEEN:
+    return attacks_from<QUEEN>(from) & to;
+  default:
+    return false;
+  }
+}
+
+namespace
+{
+enum Stage
+{
+  MAIN_TT,
+  CAPTURES_INIT,
+  GOOD_CAPTURES,
+  KILLERS,
+  QUIETS_INIT,
+  QUIET_MOVES,
+  BAD_CAPTURES,
+  EVASION_TT,
+  EVASION_INIT,
+  EVASION_MOVES,
+  QSEARCH_TT,
+  QCAPTURES_INIT,
+  QCAPTURES,
+  QCHECKS_INIT,
+  QCHECKS
+};
+} // namespace
+
+MovePicker::MovePicker(Position const &p, Move ttm, Move const *killerMoves,
+                       History const &h, int perturb)
+    : pos(p), history(h), perturbation(perturb), checks(false),
+      stage(p.in_check() ? EVASION_TT : MAIN_TT)
+{
+  ttMove = pos.is_legal(ttm) ? ttm : Move(NO_MOVE);
+  killers[0] = killerMoves[0];
+  killers[1] = killerMoves[1];
+}
+
+MovePicker::MovePicker(Position const &p, Move ttm, History const &h,
+                       int depth)
+    : pos(p), history(h), perturbation(0),
+      checks(depth == 0 && !p.in_check()),
+      stage(p.in_check() ? EVASION_TT : QSEARCH_TT)
+{
+  ttMove = pos.is_legal(ttm) && (pos.in_check() || is_capture_stage(pos, ttm))
+               ? ttm
+               : Move(NO_MOVE);
+}
+
+int MovePicker::mvv_lva(Move m) const
+{
+  return 64 + 8 * piece_type_of(pos.piece(get_to(m))) -
+         piece_type_of(pos.piece(get_from(m))) +
+         (get_move_type(m) == PROMOTION ? 8 * QUEEN : 0);
+}
+
+void MovePicker::score_captures()
+{
+  for (ValueMove *m = cur; m != endMoves; ++m)
+    m->v = mvv_lva(m->m);
+}
+
+void MovePicker::score_quiets()
+{
+  Color us = pos.side_to_move();
+  for (ValueMove *m = cur; m != endMoves; ++m)
+    m->v = History::MAX + history.get(us, m->m) +
+           (perturbation ? (m->m * 0x9e37u + perturbation * 0x7f4au) >> 8 & 63
+                         : 0);
+}
+
+// Captures by MVV-LVA, above the quiets by history
+void MovePicker::score_evasions()
+{
+  Color us = pos.side_to_move();
+  for (ValueMove *m = cur; m != endMoves; ++m)
+    m->v = is_capture_stage(pos, m->m) ? 2 * History::MAX + mvv_lva(m->m)
+                                       : History::MAX + history.get(us, m->m);
+}
+
+// Captures losing material in the exchanges are tried last. The margin keeps
+// bishop for knight trades with the good captures.
+bool MovePicker::bad_capture(Move m) const
+{
+  return !pos.see(m, Value(-PawnValue / 2));
+}
+
+// Partial selection sort : only the moves actually tried get sorted
+ValueMove *MovePicker::pick_best()
+{
+  std::swap(*cur, *std::max_element(
+                      cur, endMoves, [](ValueMove const &a, ValueMove const &b) {
+                        return a.v < b.v;
+                      }));
+  return cur++;
+}
+
+Move MovePicker::next_move()
+{
+  switch (stage)
+  {
+  case MAIN_TT:
+  case EVASION_TT:
+  case QSEARCH_TT:
+    ++stage;
+    if (ttMove)
+      return ttMove;
+    return next_move();
+
+  case CAPTURES_INIT:
+  case QCAPTURES_INIT:
+    cur = endBadCaptures = moves;
+    endMoves = pos.generate_moves<CAPTURES>(moves);
+    score_captures();
+    ++stage;
+    return next_move();
+
+  case GOOD_CAPTURES:
+    while (cur != endMoves)
+    {
+      ValueMove *m = pick_best();
+      if (m->m == ttMove)
+        continue;
+      if (bad_capture(m->m))
+        *endBadCaptures++ = *m;
+      else
+        return m->m;
+    }
+    ++stage;
+    cur = killers;
+    endMoves = killers + 2;
+    [[fallthrough]];
+
+  case KILLERS:
+    while (cur != endMoves)
+    {
+      Move m = (cur++)->m;
+      if (m != ttMove && !is_capture_stage(pos, m) && pos.is_legal(m))
+        return m;
+    }
+    ++stage;
+    [[fallthrough]];
+
+  case QUIETS_INIT:
+    cur = endBadCaptures;
+    endMoves = pos.generate_moves<QUIETS>(cur);
+    score_quiets();
+    stage = QUIET_MOVES;
+    [[fallthrough]];
+
+  case QUIET_MOVES:
+    while (cur != endMoves)
+    {
+      Move m = pick_best()->m;
+      if (m != ttMove && m != killers[0].m && m != killers[1].m)
+        return m;
+    }
+    ++stage;
+    cur = moves;
+    endMoves = endBadCaptures;
+    [[fallthrough]];
+
+  case BAD_CAPTURES:
+    return cur != endMoves ? (cur++)->m : Move(NO_MOVE);
+
+  case EVASION_INIT:
+    cur = moves;
+    endMoves = pos.generate_moves<EVASIONS>(moves);
+    score_evasions();
+    ++stage;
+    [[fallthrough]];
+
+  case EVASION_MOVES:
+  case QCAPTURES:
+    while (cur != endMoves)
+    {
+      Move m = pick_best()->m;
+      if (m != ttMove)
+        return m;
+    }
+    if (stage == EVASION_MOVES || !checks)
+      return NO_MOVE;
+    ++stage;
+    [[fallthrough]];
+
+  case QCHECKS_INIT:
+    cur = moves;
+    endMoves = pos.generate_moves<QUIET_CHECKS>(moves);
+    ++stage;
+    [[fallthrough]];
+
+  case QCHECKS:
+    return cur != endMoves ? (cur++)->m : Move(NO_MOVE);
+
+  default:
+    assert(false);
+    return NO_MOVE;
+  }
+}
+
+bool Position::gives_check(Move m) const
+{
+  Square from = get_from(m), to = get_to(m), ksq = their_king();
+  // Direct check
+  if (check_squares(piece_type_of(piece(from))) & to)
+    return true;
+  // Discovered check
+  if ((state->blockers[!stm] & from) && !(lineBB[ksq][from] & to))
+    return true;
+
+  switch (get_move_type(m))
+  {
+  case PROMOTION:
+  {
+    Bitboard occupied = pieces() ^ from;
+    switch (get_prom(m))
+    {
+    case KNIGHT:
+      return knightPseudoAttacks[to] & ksq;
+    case BISHOP:
+      return slider_attacks<BISHOP>(to, occupied) & ksq;
+    case ROOK:
+      return slider_attacks<ROOK>(to, occupied) & ksq;
+    default:
+      return slider_attacks<QUEEN>(to, occupied) & ksq;
+    }
+  }
+  case EN_PASSANT:
+  {
+    // The captured pawn may uncover a check as well
+    Bitboard occupied = (pieces() ^ from ^ (to + down(stm))) | to;
+    return (slider_attacks<BISHOP>(ksq, occupied) & pieces(BISHOP, QUEEN) &
+            pieces(stm)) |
+           (slider_attacks<ROOK>(ksq, occupied) & pieces(ROOK, QUEEN) &
+            pieces(stm));
+  }
+  case CASTLING:
+  {
+    size_t i = (stm << 1) | (file_of(from) > file_of(to));
+    Square rfrom = castlingRookMove[i][0], rto = castlingRookMove[i][1];
+    Bitboard occupied = (pieces() ^ from ^ rfrom) | to | rto;
+    return slider_attacks<ROOK>(rto, occupied) & ksq;
+  }
+  default:
+    return false;
+  }
+}
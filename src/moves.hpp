@@ -1,37 +1,100 @@
-#ifndef MOVEMAN_DEFINED
-#define MOVEMAN_DEFINED
-#include "misc.hpp"
-#include "position.hpp"
-#include "types.hpp"
-
-class Moves
-{
-public:
-  Moves() { pos = nullptr; };
-  Moves(const Position *const p) { set_pos(p); }
-  Moves(Moves const &) = delete;
-  Moves(Moves &&) = default;
-  Moves &operator=(Moves &&) = default;
-
-  void set_pos(const Position *const p)
-  {
-    pos = p;
-    currentMove = moves;
-    lastMove = pos->generate_moves(moves);
-  }
-
-  Move next_move()
-  {
-    return (currentMove != lastMove) ? *(currentMove++) : NO_MOVE;
-  }
-  int size() const { return lastMove - moves; }
-  ValueMove *begin() const { return (ValueMove *)moves; }
-  ValueMove *end() const { return lastMove; }
-
-private:
-  const Position *pos;
-  ValueMove moves[MAX_MOVES];
-  ValueMove *currentMove, *lastMove;
-};
-
+#ifndef MOVEMAN_DEFINED
+#define MOVEMAN_DEFINED
+#include "misc.hpp"
+#include "position.hpp"
+#include "types.hpp"
+#include <cstdlib>
+#include <cstring>
+
+class Moves
+{
+public:
+  Moves() { pos = nullptr; };
+  Moves(const Position *const p) { set_pos(p); }
+  Moves(Moves const &) = delete;
+  Moves(Moves &&) = default;
+  Moves &operator=(Moves &&) = default;
+
+  void set_pos(const Position *const p)
+  {
+    pos = p;
+    currentMove = moves;
+    lastMove = pos->generate_moves(moves);
+  }
+
+  Move next_move()
+  {
+    return (currentMove != lastMove) ? *(currentMove++) : NO_MOVE;
+  }
+  int size() const { return lastMove - moves; }
+  ValueMove *begin() const { return (ValueMove *)moves; }
+  ValueMove *end() const { return lastMove; }
+
+private:
+  const Position *pos;
+  ValueMove moves[MAX_MOVES];
+  ValueMove *currentMove, *lastMove;
+};
+
+// Butterfly history : how well quiet moves did in cutting off, by side to move
+// and squares. Updates are damped so that the values stay within MAX.
+struct History
+{
+  static constexpr int MAX = 8192;
+
+  inline int get(Color c, Move m) const
+  {
+    return table[c][get_from(m)][get_to(m)];
+  }
+  inline void update(Color c, Move m, int bonus)
+  {
+    int16_t &h = table[c][get_from(m)][get_to(m)];
+    h += bonus - h * std::abs(bonus) / MAX;
+  }
+  void clear() { std::memset(table, 0, sizeof(table)); }
+
+private:
+  int16_t table[NB_COLOR][NB_SQUARE][NB_SQUARE];
+};
+
+// Returns the moves one at a time, generating each stage only when it is
+// reached : hash move, good captures by MVV-LVA, killers, quiets by history
+// and bad captures. In quiescence, only the hash move and the captures, then
+// the quiet checks at depth 0. In check, the hash move and the evasions.
+class MovePicker
+{
+public:
+  MovePicker(Position const &p, Move ttm, Move const *killerMoves,
+             History const &h, int perturbation);
+  MovePicker(Position const &p, Move ttm, History const &h, int depth);
+  MovePicker(MovePicker const &) = delete;
+
+  Move next_move();
+
+private:
+  int mvv_lva(Move m) const;
+  void score_captures();
+  void score_quiets();
+  void score_evasions();
+  bool bad_capture(Move m) const;
+  ValueMove *pick_best();
+
+  const Position &pos;
+  const History &history;
+  Move ttMove;
+  ValueMove killers[2];
+  int perturbation; // shuffles the quiets of helper threads
+  bool checks;      // quiet checks after the captures in quiescence
+  int stage;
+  ValueMove *cur, *endMoves, *endBadCaptures;
+  ValueMove moves[MAX_MOVES];
+};
+
+// Captures and queen promotions are searched before the killers
+inline bool is_capture_stage(Position const &pos, Move m)
+{
+  return get_move_type(m) == PROMOTION ? get_prom(m) == QUEEN
+                                       : pos.is_capture(m);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,395 @@
+#include "nnue.hpp"
+#include "position.hpp"
+#include "tt.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+namespace NNUE
+{
+namespace
+{
+// A network file is a header followed by the parameters, in one of two
+// layouts :
+// - PORTABLE, the arrays of Network in order, packed, as written by trainers.
+//   Weights of a layer are stored by output.
+// - NATIVE, the image of Network itself, used in place once mapped.
+// A portable file is converted once into a native cache next to it, so that
+// later loads only map a file. Read-only shared mappings let every engine
+// process on the machine use the same physical pages.
+enum Layout : uint32_t
+{
+  PORTABLE,
+  NATIVE
+};
+
+struct Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t dims[4];
+  uint32_t layout;
+  uint32_t padding;
+  uint64_t checksum; // of what follows the header
+  uint64_t source;   // for a cache, checksum of the file it was converted from
+  char reserved[16];
+};
+// Keeps the parameters of a mapped native file aligned
+static_assert(sizeof(Header) == 64);
+
+constexpr uint32_t MAGIC = 0x4e4e544b; // "KTNN"
+constexpr uint32_t VERSION = 2;
+constexpr char CACHE_SUFFIX[] = ".native";
+
+struct Network
+{
+  alignas(64) int16_t ftBias[L1];
+  alignas(64) int16_t ftWeights[INPUTS][L1];
+  alignas(64) int32_t bias1[L2];
+  alignas(64) int8_t weights1[L2][2 * L1];
+  alignas(64) int32_t bias2[L3];
+  alignas(64) int8_t weights2[L3][L2];
+  int32_t biasOut;
+  alignas(64) int8_t weightsOut[L3];
+};
+
+constexpr size_t PORTABLE_SIZE =
+    sizeof(int16_t) * (L1 + INPUTS * L1) + sizeof(int32_t) * (L2 + L3 + 1) +
+    sizeof(int8_t) * (L2 * 2 * L1 + L3 * L2 + L3);
+
+// The network in use : either a mapped native file, or a converted copy when
+// the cache could not be written
+const Network *net = nullptr;
+void *netMemory = nullptr;
+size_t netSize;
+bool netFile, netMapped;
+unsigned netId = 0;
+
+// Output scale of the hidden layers, and of the network to engine units
+constexpr int WEIGHT_SHIFT = 6;
+constexpr int OUTPUT_SCALE = 16;
+
+// FNV-1a on 64 bit words, the tail padded with zeroes
+uint64_t checksum(const char *data, size_t size)
+{
+  uint64_t h = 0xcbf29ce484222325ULL, w;
+  for (; size >= 8; data += 8, size -= 8)
+  {
+    std::memcpy(&w, data, 8);
+    h = (h ^ w) * 0x100000001b3ULL;
+  }
+  if (size)
+  {
+    w = 0;
+    std::memcpy(&w, data, size);
+    h = (h ^ w) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// Maps a whole file read-only, nullptr on failure
+const char *map_file(std::string const &file, size_t &size)
+{
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  void *mem = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size > 0)
+  {
+    size = st.st_size;
+    mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mem == MAP_FAILED)
+    return nullptr;
+  madvise(mem, size, MADV_WILLNEED);
+  return static_cast<const char *>(mem);
+}
+
+const Header &header(const char *data)
+{
+  return *reinterpret_cast<const Header *>(data);
+}
+
+bool valid(const char *data, size_t size, Layout layout)
+{
+  if (size < sizeof(Header))
+    return false;
+  const Header &h = header(data);
+  return h.magic == MAGIC && h.version == VERSION && h.dims[0] == INPUTS &&
+         h.dims[1] == L1 && h.dims[2] == L2 && h.dims[3] == L3 &&
+         h.layout == layout &&
+         size - sizeof(Header) ==
+             (layout == NATIVE ? sizeof(Network) : PORTABLE_SIZE) &&
+         h.checksum == checksum(data + sizeof(Header), size - sizeof(Header));
+}
+
+template <typename T>
+void read(const char *&data, T *dst, size_t n)
+{
+  std::memcpy(dst, data, n * sizeof(T));
+  data += n * sizeof(T);
+}
+
+void convert(const char *data, Network *n)
+{
+  std::memset(n, 0, sizeof(Network));
+  read(data, n->ftBias, L1);
+  read(data, &n->ftWeights[0][0], INPUTS * L1);
+  read(data, n->bias1, L2);
+  read(data, &n->weights1[0][0], L2 * 2 * L1);
+  read(data, n->bias2, L3);
+  read(data, &n->weights2[0][0], L3 * L2);
+  read(data, &n->biasOut, 1);
+  read(data, n->weightsOut, L3);
+}
+
+// Written under a temporary name then renamed, so that processes converting
+// the same file at once never map a partial cache
+bool write_cache(std::string const &file, Header const &h, const Network *n)
+{
+  std::string tmp = file + '.' + std::to_string(getpid());
+  std::ofstream os(tmp, std::ios::binary);
+  bool ok = bool(os.write(reinterpret_cast<const char *>(&h), sizeof(h))) &&
+            bool(os.write(reinterpret_cast<const char *>(n), sizeof(Network)));
+  os.close();
+  if (ok && !os.fail() && !std::rename(tmp.c_str(), file.c_str()))
+    return true;
+  std::remove(tmp.c_str());
+  return false;
+}
+
+void release()
+{
+  if (!netMemory)
+    return;
+  if (netFile)
+    munmap(netMemory, netSize);
+  else
+    large_free(netMemory, netSize, netMapped);
+  net = nullptr;
+  netMemory = nullptr;
+}
+
+void use_file(const char *data, size_t size)
+{
+  release();
+  netMemory = const_cast<char *>(data);
+  netSize = size;
+  netFile = true;
+  net = reinterpret_cast<const Network *>(data + sizeof(Header));
+  ++netId;
+}
+
+// Index of a piece for the perspective of a side, whose squares are mirrored
+// for black so that both play up the board
+inline int feature(Color perspective, Square ksq, Piece p, Square sq)
+{
+  int orient = perspective == WHITE ? 0 : 56;
+  int pieceIdx = 2 * (piece_type_of(p) - PAWN) + (color_of(p) != perspective);
+  return ((ksq ^ orient) * 10 + pieceIdx) * 64 + (sq ^ orient);
+}
+
+inline void add_feature(int16_t *acc, int f)
+{
+  const int16_t *w = net->ftWeights[f];
+#if defined(__AVX2__)
+  for (int i = 0; i < L1; i += 16)
+  {
+    __m256i *a = reinterpret_cast<__m256i *>(acc + i);
+    *a = _mm256_add_epi16(*a, *reinterpret_cast<const __m256i *>(w + i));
+  }
+#else
+  for (int i = 0; i < L1; ++i)
+    acc[i] += w[i];
+#endif
+}
+
+inline void sub_feature(int16_t *acc, int f)
+{
+  const int16_t *w = net->ftWeights[f];
+#if defined(__AVX2__)
+  for (int i = 0; i < L1; i += 16)
+  {
+    __m256i *a = reinterpret_cast<__m256i *>(acc + i);
+    *a = _mm256_sub_epi16(*a, *reinterpret_cast<const __m256i *>(w + i));
+  }
+#else
+  for (int i = 0; i < L1; ++i)
+    acc[i] -= w[i];
+#endif
+}
+
+// Dot product of unsigned 8 bit inputs with signed 8 bit weights, n multiple
+// of 32. Products of two 7 bit values cannot saturate the pairwise sums.
+inline int32_t dot(const uint8_t *input, const int8_t *weights, int n)
+{
+#if defined(__AVX2__)
+  __m256i sum = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi16(1);
+  for (int i = 0; i < n; i += 32)
+  {
+    __m256i product = _mm256_maddubs_epi16(
+        _mm256_load_si256(reinterpret_cast<const __m256i *>(input + i)),
+        _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(product, ones));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                            _mm256_extracti128_si256(sum, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+#else
+  int32_t sum = 0;
+  for (int i = 0; i < n; ++i)
+    sum += input[i] * weights[i];
+  return sum;
+#endif
+}
+
+inline uint8_t clipped_relu(int x) { return std::clamp(x, 0, 127); }
+
+} // namespace
+
+bool load(std::string const &file)
+{
+  size_t size = 0;
+  const char *data = map_file(file, size);
+  if (!data)
+    return false;
+  if (valid(data, size, NATIVE))
+  {
+    use_file(data, size);
+    return true;
+  }
+  if (!valid(data, size, PORTABLE))
+  {
+    munmap(const_cast<char *>(data), size);
+    return false;
+  }
+
+  Header h = header(data);
+  std::string cacheFile = file + CACHE_SUFFIX;
+  size_t cacheSize = 0;
+  const char *cache = map_file(cacheFile, cacheSize);
+  if (cache && valid(cache, cacheSize, NATIVE) &&
+      header(cache).source == h.checksum)
+  {
+    munmap(const_cast<char *>(data), size);
+    use_file(cache, cacheSize);
+    return true;
+  }
+  if (cache)
+    munmap(const_cast<char *>(cache), cacheSize);
+
+  bool mapped;
+  Network *n = static_cast<Network *>(large_alloc(sizeof(Network), mapped));
+  convert(data + sizeof(Header), n);
+  munmap(const_cast<char *>(data), size);
+  h.layout = NATIVE;
+  h.source = h.checksum;
+  h.checksum = checksum(reinterpret_cast<const char *>(n), sizeof(Network));
+  if (write_cache(cacheFile, h, n) &&
+      (cache = map_file(cacheFile, cacheSize)) &&
+      valid(cache, cacheSize, NATIVE))
+  {
+    large_free(n, sizeof(Network), mapped);
+    use_file(cache, cacheSize);
+    return true;
+  }
+  if (cache)
+    munmap(const_cast<char *>(cache), cacheSize);
+  // No cache, this process keeps its own copy
+  release();
+  net = n;
+  netMemory = n;
+  netSize = sizeof(Network);
+  netFile = false;
+  netMapped = mapped;
+  ++netId;
+  return true;
+}
+
+unsigned network() { return net ? netId : 0; }
+
+void refresh(Accumulator &acc, Color perspective, Square ksq,
+             Piece const *board)
+{
+  std::memcpy(acc.v[perspective], net->ftBias, sizeof(net->ftBias));
+  for (Square sq = SQ_A1; sq <= SQ_H8; ++sq)
+    if (board[sq] && piece_type_of(board[sq]) != KING)
+      add_feature(acc.v[perspective], feature(perspective, ksq, board[sq], sq));
+  acc.computed[perspective] = netId;
+}
+
+void update(Accumulator &acc, Accumulator const &previous,
+            DirtyPieces const &dirty, Color perspective, Square ksq)
+{
+  std::memcpy(acc.v[perspective], previous.v[perspective],
+              sizeof(acc.v[perspective]));
+  for (int i = 0; i < dirty.nb; ++i)
+  {
+    // Kings are not features
+    if (piece_type_of(dirty.piece[i]) == KING)
+      continue;
+    if (dirty.from[i] != NO_SQUARE)
+      sub_feature(acc.v[perspective],
+                  feature(perspective, ksq, dirty.piece[i], dirty.from[i]));
+    if (dirty.to[i] != NO_SQUARE)
+      add_feature(acc.v[perspective],
+                  feature(perspective, ksq, dirty.piece[i], dirty.to[i]));
+  }
+  acc.computed[perspective] = netId;
+}
+
+Value evaluate(Accumulator const &acc, Color stm)
+{
+  alignas(32) uint8_t input[2 * L1];
+  alignas(32) uint8_t hidden1[L2];
+  alignas(32) uint8_t hidden2[L3];
+  for (int i = 0; i < L1; ++i)
+  {
+    input[i] = clipped_relu(acc.v[stm][i]);
+    input[L1 + i] = clipped_relu(acc.v[!stm][i]);
+  }
+  for (int i = 0; i < L2; ++i)
+    hidden1[i] = clipped_relu(
+        (net->bias1[i] + dot(input, net->weights1[i], 2 * L1)) >> WEIGHT_SHIFT);
+  for (int i = 0; i < L3; ++i)
+    hidden2[i] = clipped_relu(
+        (net->bias2[i] + dot(hidden1, net->weights2[i], L2)) >> WEIGHT_SHIFT);
+  int output = (net->biasOut + dot(hidden2, net->weightsOut, L3)) / OUTPUT_SCALE;
+  // Below the tablebase wins, which are shifted by the ply in the TT
+  return Value(std::clamp(output, -(VALUE_TB_WIN_IN_MAX_PLY - 1),
+                          VALUE_TB_WIN_IN_MAX_PLY - 1));
+}
+} // namespace NNUE
+
+// Brings the accumulator of a perspective up to date, from the closest
+// computed one below in the stack. A move of that side's king changes all its
+// features, the accumulator is then computed from scratch.
+void Position::update_accumulator(Color perspective)
+{
+  unsigned id = NNUE::network();
+  Piece king = make_piece(perspective, KING);
+  Square ksq = pieceList[king][0];
+  StateInfo *st = state;
+  while (st->accumulator.computed[perspective] != id)
+  {
+    if (st == stateStack || (st->dirty.nb && st->dirty.piece[0] == king))
+    {
+      NNUE::refresh(state->accumulator, perspective, ksq, pieceBySquare);
+      return;
+    }
+    --st;
+  }
+  for (++st; st <= state; ++st)
+    NNUE::update(st->accumulator, (st - 1)->accumulator, st->dirty,
+                 perspective, ksq);
+}
@@ -0,0 +1,56 @@
+#ifndef NNUE_INCLUDED
+#define NNUE_INCLUDED
+#include "types.hpp"
+#include <string>
+
+// Quantized HalfKP network. Each side sees the other pieces relative to its
+// own king, and the two halves feed the same layers :
+//   2 x (40960 -> 256) -> clipped ReLU -> 32 -> clipped ReLU -> 32 -> 1
+// The first layer is an accumulator kept in StateInfo, updated from the one of
+// the previous ply with the pieces that moved.
+namespace NNUE
+{
+constexpr int INPUTS = 64 * 10 * 64;
+constexpr int L1 = 256;
+constexpr int L2 = 32;
+constexpr int L3 = 32;
+
+// Pieces changed by the move leading to a state, at most three for a capturing
+// promotion. NO_SQUARE as origin for a piece added, as destination for a piece
+// removed.
+struct DirtyPieces
+{
+  int nb;
+  Piece piece[3];
+  Square from[3];
+  Square to[3];
+
+  inline void add(Piece p, Square f, Square t)
+  {
+    piece[nb] = p;
+    from[nb] = f;
+    to[nb++] = t;
+  }
+};
+
+struct alignas(32) Accumulator
+{
+  int16_t v[NB_COLOR][L1];
+  // Network the perspective was computed with, 0 if it was not
+  unsigned computed[NB_COLOR];
+};
+
+// Maps the network file, converting it first to a cached native layout if
+// needed, see nnue.cpp. Returns false if the file is missing or invalid.
+bool load(std::string const &file);
+// Identifier of the loaded network, 0 if there is none
+unsigned network();
+
+void refresh(Accumulator &acc, Color perspective, Square ksq,
+             Piece const *board);
+void update(Accumulator &acc, Accumulator const &previous,
+            DirtyPieces const &dirty, Color perspective, Square ksq);
+Value evaluate(Accumulator const &acc, Color stm);
+} // namespace NNUE
+
+#endif
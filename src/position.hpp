@@ -1,189 +1,299 @@
-#ifndef POSITION_DEFINED
-#define POSITION_DEFINED
-#include "bitboards.hpp"
-#include "misc.hpp"
-#include "types.hpp"
-#include <cassert>
-#include <ostream>
-#include <stack>
-#include <string>
-#include <vector>
-
-struct StateInfo
-{
-  int castlingRights;
-  int rule50;
-
-  Square epSquare;
-  Piece capturedPiece;
-  Bitboard blockers[NB_COLOR];
-  Bitboard pinners[NB_COLOR];
-  Bitboard checkers;
-
-  Move move;
-};
-
-class Position
-{
-public:
-  Position();
-  Position(Position &&) = default;
-  Position &operator=(Position &&) = default;
-  Position(Position const &) = delete;
-  void set_position(std::string fen);
-  void rebase_stack(); // sets current position as root position
-
-  void do_move(Move m);
-  void do_move(std::string str);
-  void undo_move();
-  void do_null_move();
-  void undo_null_move();
-
-  template <PieceType pt>
-  Bitboard attacks_from(Square sq) const;
-  template <PieceType pt>
-  Bitboard attacks_from(Square sq, Color c) const;
-  Bitboard attacks_to(Square sq) const;
-
-  Bitboard pieces() const;
-  Bitboard pieces(Piece) const;
-  Bitboard pieces(PieceType) const;
-  Bitboard pieces(PieceType, PieceType) const;
-  Bitboard pieces(PieceType, Color) const;
-  Bitboard pieces(Color) const;
-  Piece piece(Square) const;
-  Square our_king() const;
-  Square their_king() const;
-
-  inline Key get_key() const { return key; }
-
-  bool is_pinned(Square) const;
-  bool in_check() const;
-
-  ValueMove *generate_moves(ValueMove *moveList) const;
-
-  bool is_valid() const;
-  std::string to_fen() const;
-  friend std::ostream &operator<<(std::ostream &, Position const &);
-
-  Estimate estimate();
-
-private:
-  void reset();
-  void next_state();
-  void restore_state();
-  void put_piece(Square, Piece);
-  void remove_piece(Square);
-  void move_piece(Square from, Square to);
-  void set_cs_right(char token); // used to read FEN
-  void compute_pins();
-
-  // Move generation
-  template <PieceType, Color>
-  ValueMove *generate_moves(ValueMove *moveList, Bitboard target) const;
-
-  template <Color>
-  ValueMove *generate_pawn_moves(ValueMove *moveList, Bitboard target) const;
-
-  template <Color>
-  ValueMove *generate_king_moves(ValueMove *moveList, Bitboard target) const;
-
-  Bitboard bbByPieceType[NB_PIECE_TYPE];
-  Bitboard bbByColor[NB_COLOR];
-  Piece pieceBySquare[NB_SQUARE];
-  Square pieceList[NB_PIECE][MAX_PIECE_NB];
-  size_t index[NB_SQUARE];
-  size_t nbPiece[NB_PIECE];
-
-  Key key;
-  Color stm;
-  int ply;
-  StateInfo *state;
-  StateInfo stateStack[MAX_PLY];
-};
-
-inline Bitboard Position::pieces() const { return bbByPieceType[ALL_PIECE]; }
-
-inline Bitboard Position::pieces(Piece p) const
-{
-  return bbByPieceType[piece_type_of(p)] & bbByColor[color_of(p)];
-}
-
-inline Bitboard Position::pieces(PieceType pt) const
-{
-  return bbByPieceType[pt];
-}
-
-inline Bitboard Position::pieces(PieceType pt1, PieceType pt2) const
-{
-  return bbByPieceType[pt1] | bbByPieceType[pt2];
-}
-
-inline Bitboard Position::pieces(PieceType pt, Color c) const
-{
-  return bbByPieceType[pt] & bbByColor[c];
-}
-
-inline Bitboard Position::pieces(Color c) const { return bbByColor[c]; }
-
-inline Piece Position::piece(Square sq) const { return pieceBySquare[sq]; }
-
-inline Square Position::our_king() const
-{
-  return pieceList[make_piece(stm, KING)][0];
-}
-
-inline Square Position::their_king() const
-{
-  return pieceList[make_piece(!stm, KING)][0];
-}
-
-inline bool Position::is_pinned(Square sq) const
-{
-  return state->blockers[stm] & sq;
-}
-
-template <PieceType pt>
-inline Bitboard Position::attacks_from(Square sq) const
-{
-  assert(pt != PAWN);
-  if (pt == BISHOP)
-    return bishopMagics[sq][magic_index<BISHOP>(pieces(), sq)];
-  if (pt == ROOK)
-    return rookMagics[sq][magic_index<ROOK>(pieces(), sq)];
-  if (pt == QUEEN)
-    return bishopMagics[sq][magic_index<BISHOP>(pieces(), sq)] |
-           rookMagics[sq][magic_index<ROOK>(pieces(), sq)];
-  if (pt == KING)
-    return ringBB[sq];
-  return knightPseudoAttacks[sq];
-}
-template <>
-inline Bitboard Position::attacks_from<PAWN>(Square sq, Color us) const
-{
-  return (pawnPseudoAttack[sq][us] & pieces());
-}
-
-inline Bitboard Position::attacks_to(Square sq) const
-{
-  return (attacks_from<BISHOP>(sq) & pieces(BISHOP, QUEEN)) |
-         (attacks_from<ROOK>(sq) & pieces(ROOK, QUEEN)) |
-         (attacks_from<KNIGHT>(sq) & pieces(KNIGHT)) |
-         (attacks_from<PAWN>(sq, stm) & pieces(PAWN, !stm)) |
-         (attacks_from<PAWN>(sq, !stm) & pieces(PAWN, stm)) |
-         (attacks_from<KING>(sq) & pieces(KING));
-}
-
-inline bool Position::in_check() const { return state->checkers; }
-
-inline void Position::rebase_stack()
-{
-  size_t rebaseSize = state->rule50;
-  StateInfo *curr = state - rebaseSize;
-  // memcpy would be undefined behaviour since source and destination overlap
-  for (size_t i = 0; i <= rebaseSize; ++i)
-    stateStack[i] = *(curr++);
-  state = stateStack + rebaseSize;
-}
-
+#ifndef POSITION_DEFINED
+#define POSITION_DEFINED
+#include "bitboards.hpp"
+#include "evaluate.hpp"
+#include "misc.hpp"
+#include "nnue.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <cassert>
+#include <ostream>
+#include <stack>
+#include <string>
+#include <vector>
+
+struct StateInfo
+{
+  int castlingRights;
+  int rule50;
+  int pliesFromNull; // repetitions cannot cross a null move
+
+  Square epSquare;
+  Piece capturedPiece;
+  Bitboard blockers[NB_COLOR];
+  Bitboard pinners[NB_COLOR];
+  Bitboard checkers;
+
+  Move move;
+  Key key; // key of the position, only set once a move is played from it
+
+  // Evaluation network, see nnue.hpp
+  NNUE::DirtyPieces dirty;
+  NNUE::Accumulator accumulator;
+};
+
+class Position
+{
+public:
+  Position();
+  Position(Position const &);
+  Position &operator=(Position const &);
+  void set_position(std::string fen);
+  void rebase_stack(); // sets current position as root position
+
+  void do_move(Move m);
+  void do_move(std::string str);
+  void undo_move();
+  void do_null_move();
+  void undo_null_move();
+
+  template <PieceType pt>
+  Bitboard attacks_from(Square sq) const;
+  template <PieceType pt>
+  Bitboard attacks_from(Square sq, Color c) const;
+  Bitboard attacks_to(Square sq) const;
+  Bitboard attacks_to(Square sq, Bitboard occupied) const;
+
+  Bitboard pieces() const;
+  Bitboard pieces(Piece) const;
+  Bitboard pieces(PieceType) const;
+  Bitboard pieces(PieceType, PieceType) const;
+  Bitboard pieces(PieceType, Color) const;
+  Bitboard pieces(Color) const;
+  Piece piece(Square) const;
+  Square our_king() const;
+  Square their_king() const;
+  Square king_square(Color) const;
+
+  inline Key get_key() const { return key; }
+  inline Key pawn_key() const { return pawnKey; }
+  inline Key material_key() const { return materialKey; }
+  // Material and piece-square scores from white's point of view
+  inline Score psq_score() const { return psq; }
+  inline int count(Piece p) const { return nbPiece[p]; }
+  // Key of the child, so that callers probing a table can prefetch its entry
+  // before making the move
+  Key key_after(Move) const;
+  // Tables of the thread evaluating the position, none by default
+  inline void set_pawn_table(PawnTable *t) { pawnTable = t; }
+  inline PawnTable *pawn_table() const { return pawnTable; }
+  inline void set_material_table(MaterialTable *t) { materialTable = t; }
+  inline MaterialTable *material_table() const { return materialTable; }
+  inline Color side_to_move() const { return stm; }
+  inline int game_ply() const { return ply; }
+  inline int rule50_count() const { return state->rule50; }
+  inline bool can_castle() const { return state->castlingRights; }
+
+  bool is_pinned(Square) const;
+  bool in_check() const;
+  bool is_draw() const;
+  bool is_capture(Move) const;
+  bool non_pawn_material(Color) const;
+
+  template <GenType gt = LEGAL>
+  ValueMove *generate_moves(ValueMove *moveList) const;
+  int count_moves() const;
+  bool is_legal(Move) const;
+  bool gives_check(Move) const;
+  bool see(Move, Value threshold) const;
+
+  bool is_valid() const;
+  std::string to_fen() const;
+  friend std::ostream &operator<<(std::ostream &, Position const &);
+
+  Estimate estimate();
+
+private:
+  void reset();
+  void pass_turn();
+  void next_state();
+  void restore_state();
+  void put_piece(Square, Piece);
+  void remove_piece(Square);
+  void move_piece(Square from, Square to);
+  void set_cs_right(char token); // used to read FEN
+  void compute_pins();
+  void update_accumulator(Color perspective);
+
+  // Move generation
+  void legal_targets(Bitboard &target, Bitboard &ktarget) const;
+
+  template <Color, GenType>
+  ValueMove *generate_moves(ValueMove *moveList) const;
+
+  template <PieceType, Color>
+  ValueMove *generate_piece_moves(ValueMove *moveList, Bitboard target) const;
+
+  template <Color, GenType>
+  ValueMove *generate_pawn_moves(ValueMove *moveList, Bitboard target) const;
+
+  template <Color, GenType>
+  ValueMove *generate_king_moves(ValueMove *moveList, Bitboard target) const;
+
+  Bitboard check_squares(PieceType) const;
+
+  template <PieceType, Color>
+  ValueMove *generate_piece_checks(ValueMove *moveList, Bitboard target) const;
+
+  template <Color>
+  ValueMove *generate_quiet_checks(ValueMove *moveList) const;
+
+  template <Color>
+  ValueMove *generate_evasions(ValueMove *moveList) const;
+
+  template <Color>
+  Bitboard en_passant_pawns(Bitboard target) const;
+
+  template <Color>
+  unsigned legal_castlings() const;
+
+  template <Color>
+  int count_moves(Bitboard target, Bitboard ktarget) const;
+
+  template <PieceType, Color>
+  int count_piece_moves(Bitboard target) const;
+
+  Bitboard bbByPieceType[NB_PIECE_TYPE];
+  Bitboard bbByColor[NB_COLOR];
+  Piece pieceBySquare[NB_SQUARE];
+  Square pieceList[NB_PIECE][MAX_PIECE_NB];
+  size_t index[NB_SQUARE];
+  size_t nbPiece[NB_PIECE];
+
+  Key key;
+  Key pawnKey;
+  Key materialKey;
+  Score psq;
+  PawnTable *pawnTable;
+  MaterialTable *materialTable;
+  Color stm;
+  int ply;
+  StateInfo *state;
+  StateInfo stateStack[MAX_PLY];
+};
+
+inline Bitboard Position::pieces() const { return bbByPieceType[ALL_PIECE]; }
+
+inline Bitboard Position::pieces(Piece p) const
+{
+  return bbByPieceType[piece_type_of(p)] & bbByColor[color_of(p)];
+}
+
+inline Bitboard Position::pieces(PieceType pt) const
+{
+  return bbByPieceType[pt];
+}
+
+inline Bitboard Position::pieces(PieceType pt1, PieceType pt2) const
+{
+  return bbByPieceType[pt1] | bbByPieceType[pt2];
+}
+
+inline Bitboard Position::pieces(PieceType pt, Color c) const
+{
+  return bbByPieceType[pt] & bbByColor[c];
+}
+
+inline Bitboard Position::pieces(Color c) const { return bbByColor[c]; }
+
+inline Piece Position::piece(Square sq) const { return pieceBySquare[sq]; }
+
+inline Square Position::our_king() const
+{
+  return pieceList[make_piece(stm, KING)][0];
+}
+
+inline Square Position::their_king() const
+{
+  return pieceList[make_piece(!stm, KING)][0];
+}
+
+inline Square Position::king_square(Color c) const
+{
+  return pieceList[make_piece(c, KING)][0];
+}
+
+inline bool Position::is_pinned(Square sq) const
+{
+  return state->blockers[stm] & sq;
+}
+
+template <PieceType pt>
+inline Bitboard Position::attacks_from(Square sq) const
+{
+  assert(pt != PAWN);
+  if (pt == BISHOP)
+    return bishopMagics[sq][magic_index<BISHOP>(pieces(), sq)];
+  if (pt == ROOK)
+    return rookMagics[sq][magic_index<ROOK>(pieces(), sq)];
+  if (pt == QUEEN)
+    return bishopMagics[sq][magic_index<BISHOP>(pieces(), sq)] |
+           rookMagics[sq][magic_index<ROOK>(pieces(), sq)];
+  if (pt == KING)
+    return ringBB[sq];
+  return knightPseudoAttacks[sq];
+}
+template <>
+inline Bitboard Position::attacks_from<PAWN>(Square sq, Color us) const
+{
+  return (pawnPseudoAttack[sq][us] & pieces());
+}
+
+inline Bitboard Position::attacks_to(Square sq) const
+{
+  return (attacks_from<BISHOP>(sq) & pieces(BISHOP, QUEEN)) |
+         (attacks_from<ROOK>(sq) & pieces(ROOK, QUEEN)) |
+         (attacks_from<KNIGHT>(sq) & pieces(KNIGHT)) |
+         (attacks_from<PAWN>(sq, stm) & pieces(PAWN, !stm)) |
+         (attacks_from<PAWN>(sq, !stm) & pieces(PAWN, stm)) |
+         (attacks_from<KING>(sq) & pieces(KING));
+}
+
+// Attackers of both colors with a given occupancy, to see through pieces
+inline Bitboard Position::attacks_to(Square sq, Bitboard occupied) const
+{
+  return (slider_attacks<BISHOP>(sq, occupied) & pieces(BISHOP, QUEEN)) |
+         (slider_attacks<ROOK>(sq, occupied) & pieces(ROOK, QUEEN)) |
+         (knightPseudoAttacks[sq] & pieces(KNIGHT)) |
+         (pawnPseudoAttack[sq][WHITE] & pieces(PAWN, BLACK)) |
+         (pawnPseudoAttack[sq][BLACK] & pieces(PAWN, WHITE)) |
+         (ringBB[sq] & pieces(KING));
+}
+
+inline bool Position::in_check() const { return state->checkers; }
+
+inline bool Position::is_capture(Move m) const
+{
+  return piece(get_to(m)) || get_move_type(m) == EN_PASSANT;
+}
+
+inline bool Position::non_pawn_material(Color c) const
+{
+  return pieces(c) & ~pieces(PAWN, KING);
+}
+
+// Fifty moves rule and repetitions. A single repetition is enough inside the
+// search tree. A mate on the hundredth half-move still wins.
+inline bool Position::is_draw() const
+{
+  if (state->rule50 > 99 && !(in_check() && !count_moves()))
+    return true;
+  int end = std::min<int>({state->rule50, state->pliesFromNull,
+                           int(state - stateStack)});
+  for (int i = 4; i <= end; i += 2)
+    if ((state - i)->key == key)
+      return true;
+  return false;
+}
+
+inline void Position::rebase_stack()
+{
+  size_t rebaseSize = std::min<size_t>(state->rule50, state - stateStack);
+  StateInfo *curr = state - rebaseSize;
+  // memcpy would be undefined behaviour since source and destination overlap
+  for (size_t i = 0; i <= rebaseSize; ++i)
+    stateStack[i] = *(curr++);
+  state = stateStack + rebaseSize;
+}
+
 #endif
\ No newline at end of file
@@ -1,45 +1,619 @@
-#include "misc.hpp"
-#include "moves.hpp"
-#include "threads.hpp"
-#include "types.hpp"
-#include <algorithm>
-#include <iostream>
-
-void Thread::search() {
-
-  Moves moves(&pos), moves_opponent;
-  if (idx != 0)
-    return;
-  ValueMove m;
-  while ((m = moves.next_move())) {
-    pos.do_move(m);
-    moves_opponent.set_pos(&pos);
-    if (pos.in_check() && moves_opponent.size() == 0) {
-      std::cout << Sync::lock << "bestmove "
-                << (MovePrint)(Move)(moves.size() == 0 ? NULL_MOVE
-                                                       : m ? m : *moves.begin())
-                << std::endl
-                << Sync::unlock;
-      return;
-    }
-    pos.undo_move();
-    if (pos.piece(get_to(m)) != NO_PIECE) {
-      std::cout << Sync::lock << "bestmove "
-                << (MovePrint)(Move)(moves.size() == 0 ? NULL_MOVE
-                                                       : m ? m : *moves.begin())
-                << std::endl
-                << Sync::unlock;
-      return;
-    }
-  }
-
-  std::shuffle(moves.begin(), moves.end(), gen);
-  std::cout << Sync::lock << "bestmove " << (MovePrint)(Move)(*moves.begin())
-            << std::endl
-            << Sync::unlock;
-  std::cout << Sync::lock
-            << "info depth 0 nodes 1 score cp 100 nps 0 tbhits 0 pv "
-            << (MovePrint)(Move)(*moves.begin()) << std::endl
-            << Sync::unlock;
-  return;
-}
+#include "misc.hpp"
+#include "moves.hpp"
+#include "options.hpp"
+#include "tbprobe.hpp"
+#include "threads.hpp"
+#include "tt.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+// The root may sit up to 100 plies deep into the state stack after
+// Position::rebase_stack, the search must not overflow it.
+constexpr int MAX_SEARCH_PLY = MAX_PLY / 2;
+
+// Lazy SMP : helper threads skip some iterations so that they do not all
+// search the same depth at the same time
+constexpr int SkipSize[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                            3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+constexpr int SkipPhase[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3,
+                             4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+constexpr int SkipEntries = sizeof(SkipSize) / sizeof(*SkipSize);
+
+std::string uci_value(Value v) {
+  if (std::abs(v) < VALUE_MATE_IN_MAX_PLY)
+    return "cp " + std::to_string(v * 100 / PawnValue);
+  return "mate " + std::to_string(v > 0 ? (VALUE_MATE - v + 1) / 2
+                                        : -(VALUE_MATE + v) / 2);
+}
+
+// Mate and tablebase scores are stored relative to the node, not to the root
+inline Value value_to_tt(Value v, int ply) {
+  return v >= VALUE_TB_WIN_IN_MAX_PLY    ? Value(v + ply)
+         : v <= VALUE_TB_LOSS_IN_MAX_PLY ? Value(v - ply)
+                                         : v;
+}
+
+inline Value value_from_tt(Value v, int ply) {
+  return v >= VALUE_TB_WIN_IN_MAX_PLY    ? Value(v - ply)
+         : v <= VALUE_TB_LOSS_IN_MAX_PLY ? Value(v + ply)
+                                         : v;
+}
+
+// Whether a stored value can be returned without searching
+inline bool tt_cutoff(Value ttValue, Bound bound, Value beta) {
+  return bound & (ttValue >= beta ? BOUND_LOWER : BOUND_UPPER);
+}
+
+} // namespace
+
+HashTable<TTEntry> TT;
+
+// The cutoff move becomes a killer and gains history, the quiets tried before
+// it lose some
+void Thread::update_quiet_stats(int ply, int depth, Move move,
+                                Move const *quiets, int quietCount) {
+  if (killers[ply][0] != move) {
+    killers[ply][1] = killers[ply][0];
+    killers[ply][0] = move;
+  }
+  Color us = pos.side_to_move();
+  int bonus = std::min(depth * depth, 400);
+  history.update(us, move, bonus);
+  for (int i = 0; i < quietCount; ++i)
+    history.update(us, quiets[i], -bonus);
+}
+
+void Thread::update_pv(int ply, Move m) {
+  pv[ply][ply] = m;
+  for (int i = ply + 1; i < pvLength[ply + 1]; ++i)
+    pv[ply][i] = pv[ply + 1][i];
+  pvLength[ply] = std::max(ply + 1, pvLength[ply + 1]);
+}
+
+template <bool PvNode>
+Value Thread::quiescence(Value alpha, Value beta, int depth, int ply) {
+  count_node();
+  pvLength[ply] = ply;
+  selDepth = std::max(selDepth, ply);
+  if (stopped)
+    return VALUE_ZERO;
+  if (pos.is_draw())
+    return VALUE_DRAW;
+  if (ply >= MAX_SEARCH_PLY - 1)
+    return pos.estimate().v;
+
+  Value oldAlpha = alpha;
+  Key key = pos.get_key();
+  TTEntry tte;
+  bool ttHit;
+  TTEntry *slot = TT.probe(key, tte, ttHit);
+  Value ttValue = ttHit ? value_from_tt(tte.value(), ply) : VALUE_NONE;
+  if (!PvNode && ttHit && tte.depth() >= depth &&
+      tt_cutoff(ttValue, tte.bound(), beta))
+    return ttValue;
+
+  bool inCheck = pos.in_check();
+  Value bestValue = -VALUE_INFINITE, eval = VALUE_NONE;
+  if (!inCheck) {
+    // Stand pat. Tablebase hits and nodes in check are stored without eval.
+    eval = ttHit && tte.eval() != VALUE_NONE ? tte.eval() : pos.estimate().v;
+    bestValue = eval;
+    if (bestValue >= beta) {
+      if (!ttHit)
+        slot->save(key, value_to_tt(bestValue, ply), BOUND_LOWER, depth,
+                   NO_MOVE, eval, TT.generation());
+      return bestValue;
+    }
+    alpha = std::max(alpha, bestValue);
+  }
+
+  // Out of check, only captures and queen promotions are searched, and the
+  // quiet checks at the first ply of quiescence
+  MovePicker mp(pos, ttHit ? tte.move() : Move(NO_MOVE), history, depth);
+  Move bestMove = NO_MOVE, move;
+  int moveCount = 0;
+  while ((move = mp.next_move()) != NO_MOVE) {
+    ++moveCount;
+    // Captures losing material are not worth searching
+    if (!inCheck && !pos.see(move, VALUE_ZERO))
+      continue;
+    TT.prefetch(pos.key_after(move));
+    pos.do_move(move);
+    // Depth -1 below : no more quiet checks, and within the range of the TT
+    Value v = -quiescence<PvNode>(-beta, -alpha, -1, ply + 1);
+    pos.undo_move();
+    if (stopped)
+      return VALUE_ZERO;
+    if (v > bestValue) {
+      bestValue = v;
+      if (v > alpha) {
+        alpha = v;
+        bestMove = move;
+        if (PvNode)
+          update_pv(ply, move);
+        if (v >= beta)
+          break;
+      }
+    }
+  }
+  if (inCheck && moveCount == 0)
+    return mated_in(ply);
+  Bound bound = bestValue >= beta                ? BOUND_LOWER
+                : PvNode && bestValue > oldAlpha ? BOUND_EXACT
+                                                 : BOUND_UPPER;
+  slot->save(key, value_to_tt(bestValue, ply), bound, depth, bestMove, eval,
+             TT.generation());
+  return bestValue;
+}
+
+template <bool PvNode>
+Value Thread::alpha_beta(Value alpha, Value beta, int depth, int ply) {
+  bool inCheck = pos.in_check();
+  // Check extension
+  if (inCheck)
+    ++depth;
+  if (depth <= 0)
+    return quiescence<PvNode>(alpha, beta, 0, ply);
+
+  count_node();
+  pvLength[ply] = ply;
+  if (stopped)
+    return VALUE_ZERO;
+  if (ply) {
+    if (pos.is_draw())
+      return VALUE_DRAW;
+    if (ply >= MAX_SEARCH_PLY - 1)
+      return pos.estimate().v;
+    // Mate distance pruning
+    alpha = std::max(alpha, mated_in(ply));
+    beta = std::min(beta, mate_in(ply + 1));
+    if (alpha >= beta)
+      return alpha;
+  }
+
+  Value oldAlpha = alpha;
+  Key key = pos.get_key();
+  TTEntry tte;
+  bool ttHit;
+  TTEntry *slot = TT.probe(key, tte, ttHit);
+  Value ttValue = ttHit ? value_from_tt(tte.value(), ply) : VALUE_NONE;
+  Move ttMove = ply == 0 && pvMove ? pvMove : ttHit ? tte.move() : Move(NO_MOVE);
+  if (!PvNode && ttHit && tte.depth() >= depth &&
+      tt_cutoff(ttValue, tte.bound(), beta))
+    return ttValue;
+
+  // Tablebases : won positions are scored below the mates, closer wins
+  // first. Cursed wins and blessed losses are draws by the fifty moves rule.
+  if (ply && tbCardinality) {
+    int pieceCount = popcount(pos.pieces());
+    if (pieceCount <= tbCardinality &&
+        (pieceCount < tbCardinality || depth >= tbProbeDepth) &&
+        !pos.rule50_count() && !pos.can_castle()) {
+      Tablebases::ProbeState state;
+      Tablebases::WDLScore wdl = Tablebases::probe_wdl(pos, state);
+      if (state != Tablebases::FAIL) {
+        tbHits.store(tbHits.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+        Value v = wdl < Tablebases::WDL_BLESSED_LOSS ? Value(ply - VALUE_TB_WIN)
+                  : wdl > Tablebases::WDL_CURSED_WIN ? Value(VALUE_TB_WIN - ply)
+                                                     : VALUE_DRAW;
+        Bound bound = v > VALUE_DRAW   ? BOUND_LOWER
+                      : v < VALUE_DRAW ? BOUND_UPPER
+                                       : BOUND_EXACT;
+        if (bound == BOUND_EXACT ||
+            (bound == BOUND_LOWER ? v >= beta : v <= alpha)) {
+          slot->save(key, value_to_tt(v, ply), bound,
+                     std::min(depth + 6, MAX_SEARCH_PLY - 1), NO_MOVE,
+                     VALUE_NONE, TT.generation());
+          return v;
+        }
+      }
+    }
+  }
+
+  Value eval = VALUE_NONE;
+  if (!inCheck)
+    eval = ttHit && tte.eval() != VALUE_NONE ? tte.eval() : pos.estimate().v;
+
+  // Null move pruning
+  if (!PvNode && !inCheck && depth >= 3 &&
+      pos.non_pawn_material(pos.side_to_move()) && eval >= beta) {
+    pos.do_null_move();
+    Value v = -alpha_beta<false>(-beta, -beta + 1, depth - 3 - depth / 6,
+                                 ply + 1);
+    pos.undo_null_move();
+    if (stopped)
+      return VALUE_ZERO;
+    if (v >= beta)
+      return v >= VALUE_TB_WIN_IN_MAX_PLY ? beta : v;
+  }
+
+  MovePicker mp(pos, ttMove, killers[ply], history, idx);
+  Value bestValue = -VALUE_INFINITE;
+  Move bestMove = NO_MOVE, move;
+  Move quietsSearched[64];
+  int moveCount = 0, quietCount = 0;
+  while ((move = mp.next_move()) != NO_MOVE) {
+    // The root only searches the moves of the lines not reported yet
+    size_t rootIdx = 0;
+    if (!ply) {
+      rootIdx = std::find(rootMoves.begin() + pvIdx, rootMoves.end(), move) -
+                rootMoves.begin();
+      if (rootIdx == rootMoves.size())
+        continue;
+    }
+    uint64_t nodesBefore = ply ? 0 : nodes_searched();
+    ++moveCount;
+    TT.prefetch(pos.key_after(move));
+    pos.do_move(move);
+    Value v;
+    // Principal variation search : the first move is searched with the full
+    // window, the others with a null window and researched if they improve
+    if (moveCount == 1)
+      v = -alpha_beta<PvNode>(-beta, -alpha, depth - 1, ply + 1);
+    else {
+      v = -alpha_beta<false>(-alpha - 1, -alpha, depth - 1, ply + 1);
+      if (PvNode && v > alpha && v < beta)
+        v = -alpha_beta<true>(-beta, -alpha, depth - 1, ply + 1);
+    }
+    pos.undo_move();
+    if (!ply)
+      rootMoves[rootIdx].nodes += nodes_searched() - nodesBefore;
+    if (stopped)
+      return VALUE_ZERO;
+    if (!ply) {
+      RootMove &rm = rootMoves[rootIdx];
+      if (moveCount == 1 || v > alpha) {
+        rm.score = v;
+        rm.selDepth = selDepth;
+        rm.pv.assign(1, move);
+        rm.pv.insert(rm.pv.end(), pv[1] + 1, pv[1] + pvLength[1]);
+      } else
+        rm.score = -VALUE_INFINITE;
+    }
+    if (v > bestValue) {
+      bestValue = v;
+      if (v > alpha) {
+        if (!ply && moveCount > 1)
+          bestMoveChanges += 1;
+        alpha = v;
+        bestMove = move;
+        if (PvNode)
+          update_pv(ply, move);
+        if (v >= beta) {
+          if (!is_capture_stage(pos, move))
+            update_quiet_stats(ply, depth, move, quietsSearched, quietCount);
+          break;
+        }
+      }
+    }
+    if (!is_capture_stage(pos, move) && quietCount < 64)
+      quietsSearched[quietCount++] = move;
+  }
+  if (moveCount == 0)
+    return inCheck ? mated_in(ply) : VALUE_DRAW;
+  Bound bound = bestValue >= beta                ? BOUND_LOWER
+                : PvNode && bestValue > oldAlpha ? BOUND_EXACT
+                                                 : BOUND_UPPER;
+  slot->save(key, value_to_tt(bestValue, ply), bound, depth, bestMove, eval,
+             TT.generation());
+  return bestValue;
+}
+
+// The stop flag is only read every POLL_NODES nodes, a few dozen
+// microseconds. The main thread also stops the search for time or nodes.
+void Thread::poll() {
+  SearchLimits const &limits = Threads.limits;
+  callsCnt = limits.nodes && (main_thread() || single)
+                 ? int(std::clamp<uint64_t>(limits.nodes / 1024, 1, POLL_NODES))
+                 : POLL_NODES;
+  // Alone, the thread only counts its own nodes
+  if (single) {
+    stopped = Threads.stop.load(std::memory_order_relaxed) ||
+              (limits.nodes && nodes_searched() >= limits.nodes);
+    return;
+  }
+  if (main_thread() &&
+      ((completedDepth && (limits.use_time_management() || limits.movetime) &&
+        !Threads.ponder.load(std::memory_order_relaxed) &&
+        Time.elapsed() >= Time.maximum()) ||
+       (limits.nodes && Threads.nodes_searched() >= limits.nodes)))
+    Threads.stop = true;
+  stopped = Threads.stop.load(std::memory_order_relaxed);
+}
+
+// One line per reported move. The lines not searched yet at this depth show
+// the previous iteration, and only the one being searched may be a bound.
+void Thread::print_info(int depth, Value alpha, Value beta) const {
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - startTime)
+                     .count();
+  uint64_t nodes = Threads.nodes_searched();
+  std::cout << Sync::lock;
+  for (size_t i = 0; i < multiPV; ++i) {
+    RootMove const &rm = rootMoves[i];
+    bool updated = i <= pvIdx && rm.score != -VALUE_INFINITE;
+    if (depth == 1 && !updated && i > 0)
+      continue;
+    int d = updated ? depth : std::max(1, depth - 1);
+    Value v = updated ? rm.score : rm.previousScore;
+    if (v == -VALUE_INFINITE)
+      v = VALUE_ZERO;
+    // The tablebases know better, unless the search found a mate
+    bool tb = tbScore != VALUE_NONE && std::abs(v) < VALUE_MATE_IN_MAX_PLY;
+    bool bound = !tb && i == pvIdx && updated;
+    std::cout << "info depth " << d << " seldepth " << rm.selDepth
+              << " multipv " << i + 1 << " score "
+              << uci_value(tb ? tbScore : v)
+              << (bound && v >= beta    ? " lowerbound"
+                  : bound && v <= alpha ? " upperbound"
+                                        : "")
+              << " nodes " << nodes << " nps " << nodes * 1000 / (elapsed + 1)
+              << " hashfull " << TT.hashfull() << " tbhits "
+              << Threads.tb_hits() << " time " << elapsed << " pv";
+    for (Move m : rm.pv)
+      std::cout << ' ' << (MovePrint)m;
+    std::cout << '\n';
+  }
+  std::cout << std::flush << Sync::unlock;
+}
+
+void Thread::search() {
+  startTime = std::chrono::steady_clock::now();
+  pos.set_pawn_table(&pawnTable);
+  pos.set_material_table(&materialTable);
+  nodes = 0;
+  tbHits = 0;
+  selDepth = 0;
+  completedDepth = 0;
+  bestMoveChanges = 0;
+  callsCnt = 1;
+  stopped = false;
+  rootPv.clear();
+  rootMove = NO_MOVE;
+  rootValue = -VALUE_INFINITE;
+  std::fill(&killers[0][0], &killers[0][0] + 2 * MAX_PLY, NO_MOVE);
+  history.clear();
+
+  Moves moves(&pos);
+  std::vector<Move> legalMoves(moves.begin(), moves.end());
+  tbCardinality = Tablebases::maxCardinality;
+  tbProbeDepth = Options["SyzygyProbeDepth"];
+  tbScore = VALUE_NONE;
+  bool dtz;
+  if (Tablebases::filter_root_moves(pos, legalMoves, tbScore, dtz)) {
+    if (main_thread())
+      tbHits = legalMoves.size();
+    // Ranked by DTZ, the moves left already make progress. Ranked by WDL,
+    // the search keeps probing to find a winning line.
+    if (dtz || tbScore <= VALUE_DRAW)
+      tbCardinality = 0;
+  }
+  rootMoves.clear();
+  for (Move m : legalMoves)
+    rootMoves.emplace_back(m);
+  multiPV = std::min<size_t>(single ? 1 : (int)Options["MultiPV"],
+                             rootMoves.size());
+  pvIdx = 0;
+  pvMove = NO_MOVE;
+  if (moves.size() == 0 && main_thread())
+    std::cout << Sync::lock << "info depth 0 score "
+              << uci_value(pos.in_check() ? mated_in(0) : VALUE_DRAW)
+              << std::endl
+              << Sync::unlock;
+
+  // Iterative deepening with aspiration windows around the previous score
+  Value previousValue = VALUE_ZERO;
+  int maxDepth = Threads.limits.depth
+                     ? std::min(Threads.limits.depth, MAX_SEARCH_PLY - 1)
+                     : MAX_SEARCH_PLY - 1;
+  for (int depth = 1; moves.size() && depth <= maxDepth && !Threads.stop;
+       ++depth) {
+    if (idx && !single) {
+      int i = (idx - 1) % SkipEntries;
+      if (((depth + pos.game_ply() + SkipPhase[i]) / SkipSize[i]) % 2)
+        continue;
+    }
+    for (RootMove &rm : rootMoves)
+      rm.previousScore = rm.score;
+    // MultiPV : each line is the best move of the ones left, searched with
+    // an aspiration window around its previous score
+    for (pvIdx = 0; pvIdx < multiPV && !stopped; ++pvIdx) {
+      Value prev = rootMoves[pvIdx].previousScore;
+      pvMove = completedDepth ? rootMoves[pvIdx].move : Move(NO_MOVE);
+      selDepth = 0;
+      int delta = PawnValue / 6;
+      Value alpha = -VALUE_INFINITE, beta = VALUE_INFINITE;
+      if (depth >= 5 && prev != -VALUE_INFINITE) {
+        alpha = Value(std::max(prev - delta, -(int)VALUE_INFINITE));
+        beta = Value(std::min(prev + delta, (int)VALUE_INFINITE));
+      }
+      while (true) {
+        Value v = alpha_beta<true>(alpha, beta, depth, 0);
+        std::stable_sort(rootMoves.begin() + pvIdx, rootMoves.end());
+        if (stopped)
+          break;
+        if (v <= alpha) {
+          if (main_thread())
+            print_info(depth, alpha, beta);
+          beta = Value((alpha + beta) / 2);
+          alpha = Value(std::max(v - delta, -(int)VALUE_INFINITE));
+        } else if (v >= beta) {
+          if (main_thread())
+            print_info(depth, alpha, beta);
+          beta = Value(std::min(v + delta, (int)VALUE_INFINITE));
+        } else
+          break;
+        delta += delta / 2;
+      }
+      std::stable_sort(rootMoves.begin(), rootMoves.begin() + pvIdx + 1);
+      if (main_thread() && !stopped && pvIdx + 1 == multiPV)
+        print_info(depth, -VALUE_INFINITE, VALUE_INFINITE);
+    }
+    if (stopped)
+      break;
+    rootMove = rootMoves[0].move;
+    rootValue = rootMoves[0].score;
+    rootPv = rootMoves[0].pv;
+    completedDepth = depth;
+
+    // Unstable best moves and falling scores get more time, a best move
+    // taking most of the nodes less, a single legal move almost none
+    if (main_thread() && Threads.limits.use_time_management()) {
+      double fallingEval =
+          std::clamp(1.0 + (previousValue - rootValue) / (2.0 * PawnValue),
+                     0.5, 1.5);
+      double instability = 1.0 + bestMoveChanges;
+      double effort = double(rootMoves[0].nodes) / (nodes_searched() + 1);
+      double dominance = depth >= 8 && effort > 0.9 ? 0.5 : 1.0;
+      double total = Time.optimum() * fallingEval * instability * dominance;
+      if (rootMoves.size() == 1)
+        total = std::min(total, Time.optimum() * 0.1);
+      if (Time.elapsed() > total) {
+        if (Threads.ponder)
+          Threads.stopOnPonderhit = true;
+        else
+          Threads.stop = true;
+      }
+    }
+    bestMoveChanges /= 2;
+    previousValue = rootValue;
+  }
+
+  // Without limits or while pondering, the best move waits for stop or
+  // ponderhit
+  if (main_thread() && (Threads.limits.infinite || Threads.ponder))
+    Threads.wait_for_stop();
+
+  if (!main_thread())
+    return;
+  Threads.stop = true;
+  for (Thread &th : Threads.threads)
+    if (&th != this)
+      th.wait_for_search_finished();
+
+  Thread *best = Threads.best_thread();
+  Move bestMove = best->rootMove;
+  if (!best->completedDepth)
+    bestMove = rootMoves.size() ? rootMoves[0].move : Move(NULL_MOVE);
+  if (best != this)
+    best->print_info(best->completedDepth, -VALUE_INFINITE, VALUE_INFINITE);
+  std::cout << Sync::lock << "bestmove " << (MovePrint)bestMove;
+  if (best->completedDepth && best->rootPv.size() > 1)
+    std::cout << " ponder " << (MovePrint)best->rootPv[1];
+  std::cout << std::endl << Sync::unlock;
+}
+
+Value Thread::analyse(Position const &position, std::vector<Move> &line) {
+  pos = position;
+  single = true;
+  search();
+  single = false;
+  line.clear();
+  if (rootMoves.empty())
+    return pos.in_check() ? mated_in(0) : VALUE_DRAW;
+  if (!completedDepth) {
+    line.push_back(rootMoves[0].move);
+    return VALUE_NONE;
+  }
+  line = rootPv;
+  bool tb = tbScore != VALUE_NONE && std::abs(rootValue) < VALUE_MATE_IN_MAX_PLY;
+  return tb ? tbScore : rootValue;
+}
+
+namespace Batch {
+namespace {
+// A FEN, or the four fields of an EPD line followed by its operations
+std::string read_fen(std::string const &line) {
+  std::istringstream is(line.substr(0, line.find(';')));
+  std::string fen, token;
+  for (int i = 0; i < 4 && is >> token; ++i)
+    fen += (i ? " " : "") + token;
+  std::string clocks;
+  for (int i = 0; i < 2 && is >> token; ++i) {
+    if (token.find_first_not_of("0123456789") != std::string::npos)
+      break;
+    clocks += ' ' + token;
+  }
+  return fen + (std::count(clocks.begin(), clocks.end(), ' ') == 2 ? clocks
+                                                                   : " 0 1");
+}
+} // namespace
+
+bool analyse(std::string const &input, std::string const &output,
+             SearchLimits const &limits) {
+  std::ifstream in(input);
+  if (!in) {
+    std::cerr << "Cannot open " << input << std::endl;
+    return false;
+  }
+  std::ofstream out(output);
+  if (!out) {
+    std::cerr << "Cannot open " << output << std::endl;
+    return false;
+  }
+  Threads.stop_search();
+  Threads.limits = limits;
+  TT.new_search();
+
+  // Lines are read as the threads need them. A result finished before the
+  // ones of earlier lines waits in pending, so the output keeps the order.
+  std::mutex inMutex, outMutex;
+  size_t lines = 0, nextLine = 0;
+  std::map<size_t, std::string> pending;
+  std::atomic<uint64_t> totalNodes(0);
+  auto t0 = std::chrono::steady_clock::now();
+  Threads.run_on_all([&](size_t i) {
+    Thread &th = Threads[i];
+    Position pos;
+    std::vector<Move> line;
+    std::string text;
+    while (true) {
+      size_t lineNb;
+      {
+        std::lock_guard<std::mutex> lock(inMutex);
+        if (!std::getline(in, text))
+          return;
+        if (text.find_first_not_of(" \t\r") == std::string::npos)
+          continue;
+        lineNb = lines++;
+      }
+      std::string fen = read_fen(text);
+      pos.set_position(fen);
+      Value v = th.analyse(pos, line);
+      totalNodes += th.nodes_searched();
+      std::ostringstream os;
+      os << fen << ";bestmove "
+         << (MovePrint)(line.empty() ? Move(NULL_MOVE) : line[0])
+         << ";score " << (v == VALUE_NONE ? "none" : uci_value(v))
+         << ";depth " << th.completed_depth() << ";nodes " << th.nodes_searched()
+         << ";pv";
+      for (Move m : line)
+        os << ' ' << (MovePrint)m;
+      std::lock_guard<std::mutex> lock(outMutex);
+      pending[lineNb] = os.str();
+      for (auto it = pending.begin();
+           it != pending.end() && it->first == nextLine;
+           it = pending.erase(it), ++nextLine)
+        out << it->second << '\n';
+    }
+  });
+  out.flush();
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - t0)
+                .count();
+  std::cerr << "\nPositions : " << lines << "\nNodes : " << totalNodes
+            << "\nTime (ms) : " << ms << "\nPositions/second : "
+            << lines * 1000 / std::max<int64_t>(ms, 1) << "\nNodes/second : "
+            << totalNodes * 1000 / std::max<int64_t>(ms, 1) << std::endl;
+  return bool(out);
+}
+} // namespace Batch
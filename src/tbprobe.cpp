@@ -0,0 +1,951 @@
+#include "tbprobe.hpp"
+#include "bitboards.hpp"
+#include "misc.hpp"
+#include "moves.hpp"
+#include "position.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace Tablebases;
+
+int Tablebases::maxCardinality = 0;
+
+namespace
+{
+constexpr int TB_PIECES = 7;
+constexpr int MAX_DTZ = 1 << 18;
+
+enum TBType
+{
+  WDL,
+  DTZ
+};
+
+// Flags of a compressed table
+enum TBFlag
+{
+  STM = 1,
+  MAPPED = 2,
+  WIN_PLIES = 4,
+  LOSS_PLIES = 8,
+  WIDE = 16,
+  SINGLE_VALUE = 128
+};
+
+using Sym = uint16_t;
+
+// The file data is little endian and not aligned, but for the Huffman codes
+template <typename T>
+inline T read_le(const uint8_t *p)
+{
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+inline uint64_t read_be64(const uint8_t *p)
+{
+  return __builtin_bswap64(read_le<uint64_t>(p));
+}
+
+inline uint32_t read_be32(const uint8_t *p)
+{
+  return __builtin_bswap32(read_le<uint32_t>(p));
+}
+
+// Each symbol of the binary tree holds its two children on 12 bits each, or
+// the value itself in the left one for a leaf
+inline Sym left_sym(const uint8_t *lr) { return ((lr[1] & 0xF) << 8) | lr[0]; }
+inline Sym right_sym(const uint8_t *lr) { return (lr[2] << 4) | (lr[1] >> 4); }
+
+// Tables mapping the squares of the pieces to an index, such that positions
+// equal by symmetry share it
+int mapPawns[NB_SQUARE];
+int mapB1H1H7[NB_SQUARE];
+int mapA1D1D4[NB_SQUARE];
+int mapKK[10][NB_SQUARE];
+uint64_t binomial[TB_PIECES - 1][NB_SQUARE];
+int leadPawnIdx[TB_PIECES - 1][NB_SQUARE];
+int leadPawnsSize[TB_PIECES - 1][4];
+
+// Negative below the A1-H8 diagonal, positive above
+inline int off_a1h8(Square sq) { return int(rank_of(sq)) - int(file_of(sq)); }
+
+// The leading pawn is the closest to the edge, then the lowest
+inline bool pawns_comp(Square s1, Square s2) { return mapPawns[s1] < mapPawns[s2]; }
+
+void init_encoding()
+{
+  int code = 0;
+  for (Square sq = SQ_A1; sq <= SQ_H8; ++sq)
+    if (off_a1h8(sq) < 0)
+      mapB1H1H7[sq] = code++;
+
+  // Squares of the A1-D1-D4 triangle, the diagonal last
+  std::vector<Square> diagonal;
+  code = 0;
+  for (Square sq = SQ_A1; sq <= SQ_D4; ++sq)
+    if (off_a1h8(sq) < 0 && file_of(sq) <= FILE_D)
+      mapA1D1D4[sq] = code++;
+    else if (!off_a1h8(sq) && file_of(sq) <= FILE_D)
+      diagonal.push_back(sq);
+  for (Square sq : diagonal)
+    mapA1D1D4[sq] = code++;
+
+  // The 462 legal placements of two kings, the first one in the triangle. On
+  // the diagonal, the second one is not above it, and both on it come last.
+  std::vector<std::pair<int, Square>> bothOnDiagonal;
+  code = 0;
+  for (int idx = 0; idx < 10; ++idx)
+    for (Square s1 = SQ_A1; s1 <= SQ_D4; ++s1)
+      if (mapA1D1D4[s1] == idx && (idx || s1 == SQ_B1))
+        for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
+        {
+          if (s1 == s2 || (ringBB[s1] & s2))
+            continue;
+          else if (!off_a1h8(s1) && off_a1h8(s2) > 0)
+            continue;
+          else if (!off_a1h8(s1) && !off_a1h8(s2))
+            bothOnDiagonal.emplace_back(idx, s2);
+          else
+            mapKK[idx][s2] = code++;
+        }
+  for (auto const &p : bothOnDiagonal)
+    mapKK[p.first][p.second] = code++;
+
+  binomial[0][0] = 1;
+  for (int n = 1; n < NB_SQUARE; ++n)
+    for (int k = 0; k < TB_PIECES - 1 && k <= n; ++k)
+      binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) +
+                       (k < n ? binomial[k][n - 1] : 0);
+
+  // mapPawns counts the squares left to the other pawns when the leading one
+  // is on a square : 47 from A2, two less at each step away from it
+  int availableSquares = 47;
+  for (int leadPawnsCnt = 1; leadPawnsCnt < TB_PIECES - 1; ++leadPawnsCnt)
+    for (File f = FILE_A; f <= FILE_D; ++f)
+    {
+      int idx = 0;
+      for (Rank r = RANK_2; r <= RANK_7; ++r)
+      {
+        Square sq = make_square(f, r);
+        if (leadPawnsCnt == 1)
+        {
+          mapPawns[sq] = availableSquares--;
+          mapPawns[Square(sq ^ 7)] = availableSquares--;
+        }
+        leadPawnIdx[leadPawnsCnt][sq] = idx;
+        idx += binomial[leadPawnsCnt - 1][mapPawns[sq]];
+      }
+      leadPawnsSize[leadPawnsCnt][f] = idx;
+    }
+}
+
+// One compressed table, for a side to move and a file of the leading pawn.
+// Values are canonical Huffman codes of symbols, each symbol standing for a
+// pair of symbols down to single values (recursive pairing). Blocks decode
+// independently, a sparse index tells where the values of a range start.
+struct PairsData
+{
+  uint8_t flags;
+  int maxSymLen, minSymLen; // the value itself for SINGLE_VALUE
+  uint32_t numBlocks;
+  size_t sizeofBlock;
+  size_t span; // values between two entries of the sparse index
+  const uint8_t *lowestSym; // 16 bits, by code length
+  const uint8_t *btree;     // 24 bits, by symbol
+  const uint8_t *blockLength; // 16 bits, values in the block minus one
+  size_t blockLengthSize;
+  const uint8_t *sparseIndex; // 32 bits block and 16 bits offset
+  size_t sparseIndexSize;
+  const uint8_t *data;
+  std::vector<uint64_t> base64; // lowest code of each length, left aligned
+  std::vector<uint8_t> symlen;  // values of each symbol minus one
+  Piece pieces[TB_PIECES];      // in encoding order
+  uint64_t groupIdx[TB_PIECES + 1];
+  int groupLen[TB_PIECES + 1]; // zero terminated
+  uint16_t mapIdx[4];          // DTZ value maps by WDL result
+};
+
+// The WDL and DTZ tables of a material, named after it like "KRPvKR". The
+// stronger side is white in the file, key2 is the key with colors reversed.
+struct TBTable
+{
+  TBTable(std::string const &code, TBType t);
+  inline PairsData *get(int stm, int f)
+  {
+    return &items[type == DTZ ? 0 : stm][hasPawns ? f : 0];
+  }
+
+  TBType type;
+  std::string name;
+  std::atomic_bool ready;
+  const uint8_t *mapping;
+  size_t mapSize;
+  Key key, key2;
+  int pieceCount;
+  bool hasPawns, hasUniquePieces;
+  int pawnCount[NB_COLOR]; // of the leading color first
+  const uint8_t *dtzMap;
+  PairsData items[NB_COLOR][4];
+};
+
+TBTable::TBTable(std::string const &code, TBType t)
+    : type(t), name(code), ready(false), mapping(nullptr), mapSize(0),
+      dtzMap(nullptr)
+{
+  size_t v = code.find('v');
+  std::string w = code.substr(0, v), b = code.substr(v + 1);
+  key = material_key(w, b, WHITE);
+  key2 = material_key(w, b, BLACK);
+  pieceCount = code.size() - 1;
+  int wp = std::count(w.begin(), w.end(), 'P');
+  int bp = std::count(b.begin(), b.end(), 'P');
+  hasPawns = wp + bp;
+  hasUniquePieces = false;
+  for (std::string const &side : {w, b})
+    for (char c : std::string("PNBRQ"))
+      if (std::count(side.begin(), side.end(), c) == 1)
+        hasUniquePieces = true;
+  // The side with fewer pawns leads, for a better compression
+  bool whiteLeads = !bp || (wp && bp >= wp);
+  pawnCount[0] = whiteLeads ? wp : bp;
+  pawnCount[1] = whiteLeads ? bp : wp;
+}
+
+std::vector<std::string> tbPaths;
+std::deque<TBTable> tables;
+std::unordered_map<Key, std::pair<TBTable *, TBTable *>> tableByKey;
+
+// Full path of a file of the tablebase directories, empty if not found
+std::string find_file(std::string const &name)
+{
+  for (std::string const &dir : tbPaths)
+  {
+    std::string file = dir + '/' + name;
+    if (!access(file.c_str(), R_OK))
+      return file;
+  }
+  return "";
+}
+
+// Maps the file of a table, returns its data after the magic number
+const uint8_t *map_table(TBTable &e)
+{
+  static constexpr uint8_t magic[2][4] = {{0x71, 0xE8, 0x23, 0x5D},
+                                          {0xD7, 0x66, 0x0C, 0xA5}};
+  std::string file =
+      find_file(e.name + (e.type == WDL ? ".rtbw" : ".rtbz"));
+  int fd = file.empty() ? -1 : open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  void *mem = MAP_FAILED;
+  size_t size = 0;
+  if (!fstat(fd, &st) && st.st_size % 64 == 16)
+  {
+    size = st.st_size;
+    mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mem == MAP_FAILED)
+    return nullptr;
+  madvise(mem, size, MADV_RANDOM);
+  if (std::memcmp(mem, magic[e.type], 4))
+  {
+    munmap(mem, size);
+    return nullptr;
+  }
+  e.mapping = static_cast<const uint8_t *>(mem);
+  e.mapSize = size;
+  return e.mapping + 4;
+}
+
+void unmap_table(TBTable &e)
+{
+  if (e.mapping)
+    munmap(const_cast<uint8_t *>(e.mapping), e.mapSize);
+  e.mapping = nullptr;
+}
+
+// Groups of pieces encoded together : pieces of the same type and color, but
+// the leading group which holds the leading pawns, or the three first unique
+// pieces, or the kings. groupIdx gives the weight of each group in the index,
+// in an order stored in the file.
+void set_groups(TBTable const &e, PairsData *d, int order[], File f)
+{
+  int n = 0, firstLen = e.hasPawns ? 0 : e.hasUniquePieces ? 3 : 2;
+  d->groupLen[n] = 1;
+  for (int i = 1; i < e.pieceCount; ++i)
+    if (--firstLen > 0 || d->pieces[i] == d->pieces[i - 1])
+      d->groupLen[n]++;
+    else
+      d->groupLen[++n] = 1;
+  d->groupLen[++n] = 0;
+
+  bool pp = e.hasPawns && e.pawnCount[1]; // pawns on both sides
+  int next = pp ? 2 : 1;
+  int freeSquares = 64 - d->groupLen[0] - (pp ? d->groupLen[1] : 0);
+  uint64_t idx = 1;
+  for (int k = 0; next < n || k == order[0] || k == order[1]; ++k)
+    if (k == order[0])
+    {
+      d->groupIdx[0] = idx;
+      idx *= e.hasPawns          ? leadPawnsSize[d->groupLen[0]][f]
+             : e.hasUniquePieces ? 31332
+                                 : 462;
+    }
+    else if (k == order[1])
+    {
+      d->groupIdx[1] = idx;
+      idx *= binomial[d->groupLen[1]][48 - d->groupLen[0]];
+    }
+    else
+    {
+      d->groupIdx[next] = idx;
+      idx *= binomial[d->groupLen[next]][freeSquares];
+      freeSquares -= d->groupLen[next++];
+    }
+  d->groupIdx[n] = idx;
+}
+
+uint8_t set_symlen(PairsData *d, Sym s, std::vector<bool> &visited)
+{
+  visited[s] = true;
+  Sym sr = right_sym(d->btree + 3 * s);
+  if (sr == 0xFFF)
+    return 0;
+  Sym sl = left_sym(d->btree + 3 * s);
+  if (!visited[sl])
+    d->symlen[sl] = set_symlen(d, sl, visited);
+  if (!visited[sr])
+    d->symlen[sr] = set_symlen(d, sr, visited);
+  return d->symlen[sl] + d->symlen[sr] + 1;
+}
+
+const uint8_t *set_sizes(PairsData *d, const uint8_t *data)
+{
+  d->flags = *data++;
+  if (d->flags & SINGLE_VALUE)
+  {
+    d->numBlocks = 0;
+    d->span = d->blockLengthSize = d->sparseIndexSize = 0;
+    d->minSymLen = *data++;
+    return data;
+  }
+
+  // The index of the last group is the size of the table
+  uint64_t tbSize = d->groupIdx[std::find(d->groupLen, d->groupLen + TB_PIECES,
+                                          0) -
+                                d->groupLen];
+  d->sizeofBlock = size_t(1) << *data++;
+  d->span = size_t(1) << *data++;
+  d->sparseIndexSize = (tbSize + d->span - 1) / d->span;
+  int padding = *data++;
+  d->numBlocks = read_le<uint32_t>(data);
+  data += sizeof(uint32_t);
+  d->blockLengthSize = d->numBlocks + padding;
+  d->maxSymLen = *data++;
+  d->minSymLen = *data++;
+  d->lowestSym = data;
+
+  // Longer codes have lower values : a code of length l, left aligned on 64
+  // bits, lies between base64[l - 1] and base64[l]
+  d->base64.assign(d->maxSymLen - d->minSymLen + 1, 0);
+  for (int i = int(d->base64.size()) - 2; i >= 0; --i)
+    d->base64[i] = (d->base64[i + 1] + read_le<Sym>(data + 2 * i) -
+                    read_le<Sym>(data + 2 * (i + 1))) /
+                   2;
+  for (size_t i = 0; i < d->base64.size(); ++i)
+    d->base64[i] <<= 64 - i - d->minSymLen;
+  data += d->base64.size() * sizeof(Sym);
+
+  d->symlen.assign(read_le<uint16_t>(data), 0);
+  data += sizeof(uint16_t);
+  d->btree = data;
+  std::vector<bool> visited(d->symlen.size());
+  for (Sym s = 0; s < d->symlen.size(); ++s)
+    if (!visited[s])
+      d->symlen[s] = set_symlen(d, s, visited);
+  return data + d->symlen.size() * 3 + (d->symlen.size() & 1);
+}
+
+// DTZ values may be stored as indices into maps, one per WDL result
+const uint8_t *set_dtz_map(TBTable &e, const uint8_t *data, File maxFile)
+{
+  e.dtzMap = data;
+  for (File f = FILE_A; f <= maxFile; ++f)
+  {
+    PairsData *d = e.get(0, f);
+    if (!(d->flags & MAPPED))
+      continue;
+    if (d->flags & WIDE)
+    {
+      data += uintptr_t(data) & 1;
+      for (int i = 0; i < 4; ++i)
+      {
+        d->mapIdx[i] = uint16_t((data - e.dtzMap) / 2 + 1);
+        data += 2 * read_le<uint16_t>(data) + 2;
+      }
+    }
+    else
+      for (int i = 0; i < 4; ++i)
+      {
+        d->mapIdx[i] = uint16_t(data - e.dtzMap + 1);
+        data += *data + 1;
+      }
+  }
+  return data + (uintptr_t(data) & 1);
+}
+
+// Reads the layout of the file, false if it does not match the table
+bool init_table(TBTable &e, const uint8_t *data)
+{
+  enum
+  {
+    SPLIT = 1,
+    HAS_PAWNS = 2
+  };
+  if (bool(*data & HAS_PAWNS) != e.hasPawns ||
+      (e.type == WDL && bool(*data & SPLIT) != (e.key != e.key2)))
+    return false;
+  data++;
+
+  int sides = e.type == WDL && e.key != e.key2 ? 2 : 1;
+  File maxFile = e.hasPawns ? FILE_D : FILE_A;
+  bool pp = e.hasPawns && e.pawnCount[1];
+  for (File f = FILE_A; f <= maxFile; ++f)
+  {
+    for (int i = 0; i < sides; ++i)
+      *e.get(i, f) = PairsData();
+    int order[2][2] = {{*data & 0xF, pp ? *(data + 1) & 0xF : 0xF},
+                       {*data >> 4, pp ? *(data + 1) >> 4 : 0xF}};
+    data += 1 + pp;
+    for (int k = 0; k < e.pieceCount; ++k, ++data)
+      for (int i = 0; i < sides; ++i)
+        e.get(i, f)->pieces[k] = Piece(i ? *data >> 4 : *data & 0xF);
+    for (int i = 0; i < sides; ++i)
+      set_groups(e, e.get(i, f), order[i], f);
+  }
+  data += uintptr_t(data) & 1;
+
+  for (File f = FILE_A; f <= maxFile; ++f)
+    for (int i = 0; i < sides; ++i)
+      data = set_sizes(e.get(i, f), data);
+  if (e.type == DTZ)
+    data = set_dtz_map(e, data, maxFile);
+  for (File f = FILE_A; f <= maxFile; ++f)
+    for (int i = 0; i < sides; ++i)
+    {
+      PairsData *d = e.get(i, f);
+      d->sparseIndex = data;
+      data += d->sparseIndexSize * 6;
+    }
+  for (File f = FILE_A; f <= maxFile; ++f)
+    for (int i = 0; i < sides; ++i)
+    {
+      PairsData *d = e.get(i, f);
+      d->blockLength = data;
+      data += d->blockLengthSize * sizeof(uint16_t);
+    }
+  for (File f = FILE_A; f <= maxFile; ++f)
+    for (int i = 0; i < sides; ++i)
+    {
+      PairsData *d = e.get(i, f);
+      data = e.mapping + ((data - e.mapping + 0x3F) & ~0x3F);
+      d->data = data;
+      data += d->numBlocks * d->sizeofBlock;
+    }
+  return data <= e.mapping + e.mapSize;
+}
+
+// Tables are mapped on their first probe, by whichever thread gets there
+// first. Once ready, they are only read.
+bool mapped(TBTable &e)
+{
+  static std::mutex mutex;
+  if (e.ready.load(std::memory_order_acquire))
+    return e.mapping;
+  std::lock_guard<std::mutex> lk(mutex);
+  if (!e.ready.load(std::memory_order_relaxed))
+  {
+    const uint8_t *data = map_table(e);
+    if (data && !init_table(e, data))
+      unmap_table(e);
+    e.ready.store(true, std::memory_order_release);
+  }
+  return e.mapping;
+}
+
+// Value at an index of a table
+int decompress_pairs(PairsData *d, uint64_t idx)
+{
+  if (d->flags & SINGLE_VALUE)
+    return d->minSymLen;
+
+  // The sparse index points to the middle of a range of span values, walk the
+  // blocks from there
+  uint32_t k = uint32_t(idx / d->span);
+  uint32_t block = read_le<uint32_t>(d->sparseIndex + 6 * k);
+  int offset = read_le<uint16_t>(d->sparseIndex + 6 * k + 4);
+  offset += int(idx % d->span) - int(d->span / 2);
+  while (offset < 0)
+    offset += read_le<uint16_t>(d->blockLength + 2 * --block) + 1;
+  while (offset > read_le<uint16_t>(d->blockLength + 2 * block))
+    offset -= read_le<uint16_t>(d->blockLength + 2 * block++) + 1;
+
+  // Skip the symbols of the block until the one holding the value
+  const uint8_t *ptr = d->data + uint64_t(block) * d->sizeofBlock;
+  uint64_t buf64 = read_be64(ptr);
+  ptr += 8;
+  int buf64Size = 64;
+  Sym sym;
+  while (true)
+  {
+    int len = 0;
+    while (buf64 < d->base64[len])
+      ++len;
+    sym = Sym((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
+    sym += read_le<Sym>(d->lowestSym + 2 * len);
+    if (offset < d->symlen[sym] + 1)
+      break;
+    offset -= d->symlen[sym] + 1;
+    len += d->minSymLen;
+    buf64 <<= len;
+    buf64Size -= len;
+    if (buf64Size <= 32)
+    {
+      buf64Size += 32;
+      buf64 |= uint64_t(read_be32(ptr)) << (64 - buf64Size);
+      ptr += 4;
+    }
+  }
+
+  // Then expand the symbol down to the value
+  while (d->symlen[sym])
+  {
+    Sym left = left_sym(d->btree + 3 * sym);
+    if (offset < d->symlen[left] + 1)
+      sym = left;
+    else
+    {
+      offset -= d->symlen[left] + 1;
+      sym = right_sym(d->btree + 3 * sym);
+    }
+  }
+  return left_sym(d->btree + 3 * sym);
+}
+
+// DTZ in plies from a stored value
+int map_dtz(TBTable &e, File f, int value, WDLScore wdl)
+{
+  constexpr int WDLMap[] = {1, 3, 0, 2, 0};
+  PairsData *d = e.get(0, f);
+  if (d->flags & MAPPED)
+  {
+    int i = d->mapIdx[WDLMap[wdl + 2]] + value;
+    value = d->flags & WIDE ? read_le<uint16_t>(e.dtzMap + 2 * i)
+                            : e.dtzMap[i];
+  }
+  if ((wdl == WDL_WIN && !(d->flags & WIN_PLIES)) ||
+      (wdl == WDL_LOSS && !(d->flags & LOSS_PLIES)) ||
+      wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS)
+    value *= 2;
+  return value + 1;
+}
+
+// Looks the position up : WDL score, or DTZ for the given WDL result.
+// Positions are mirrored so that the stronger side is white and the leading
+// piece in the A1-D1-D4 triangle, or the leading pawn on files A to D.
+int probe_table(Position const &pos, TBType type, ProbeState &state,
+                WDLScore wdl = WDL_DRAW)
+{
+  if (popcount(pos.pieces()) == 2)
+    return WDL_DRAW;
+  auto it = tableByKey.find(pos.material_key());
+  TBTable *e = it == tableByKey.end() ? nullptr
+               : type == WDL          ? it->second.first
+                                      : it->second.second;
+  if (!e || !mapped(*e))
+  {
+    state = FAIL;
+    return 0;
+  }
+
+  // Symmetric tables only hold white to move
+  bool flip = (e->key == e->key2 && pos.side_to_move() == BLACK) ||
+              pos.material_key() != e->key;
+  int flipColor = flip * 8, flipSquares = flip * 56;
+  int stm = flip ^ pos.side_to_move();
+
+  Square squares[TB_PIECES];
+  Piece pieces[TB_PIECES];
+  int size = 0, leadPawnsCnt = 0;
+  Bitboard b, leadPawns = 0;
+  File tbFile = FILE_A;
+  if (e->hasPawns)
+  {
+    Piece pc = Piece(e->get(0, 0)->pieces[0] ^ flipColor);
+    leadPawns = b = pos.pieces(PAWN, color_of(pc));
+    while (b)
+      squares[size++] = Square(pop_lsb(b) ^ flipSquares);
+    leadPawnsCnt = size;
+    std::swap(squares[0], *std::max_element(squares, squares + leadPawnsCnt,
+                                            pawns_comp));
+    tbFile = File(std::min<int>(file_of(squares[0]), FILE_H - file_of(squares[0])));
+  }
+
+  // DTZ tables hold a single side to move
+  if (type == DTZ && (e->get(stm, tbFile)->flags & STM) != stm &&
+      (e->key != e->key2 || e->hasPawns))
+  {
+    state = CHANGE_STM;
+    return 0;
+  }
+
+  b = pos.pieces() ^ leadPawns;
+  while (b)
+  {
+    Square sq = pop_lsb(b);
+    squares[size] = Square(sq ^ flipSquares);
+    pieces[size++] = Piece(pos.piece(sq) ^ flipColor);
+  }
+
+  // Same order as the pieces of the table
+  PairsData *d = e->get(stm, tbFile);
+  for (int i = leadPawnsCnt; i < size - 1; ++i)
+    for (int j = i + 1; j < size; ++j)
+      if (d->pieces[i] == pieces[j])
+      {
+        std::swap(pieces[i], pieces[j]);
+        std::swap(squares[i], squares[j]);
+        break;
+      }
+
+  if (file_of(squares[0]) > FILE_D)
+    for (int i = 0; i < size; ++i)
+      squares[i] = Square(squares[i] ^ 7);
+
+  uint64_t idx;
+  if (e->hasPawns)
+  {
+    idx = leadPawnIdx[leadPawnsCnt][squares[0]];
+    std::stable_sort(squares + 1, squares + leadPawnsCnt, pawns_comp);
+    for (int i = 1; i < leadPawnsCnt; ++i)
+      idx += binomial[i][mapPawns[squares[i]]];
+  }
+  else
+  {
+    if (rank_of(squares[0]) > RANK_4)
+      for (int i = 0; i < size; ++i)
+        squares[i] = Square(squares[i] ^ 56);
+    // The first piece of the leading group off the A1-H8 diagonal goes below
+    for (int i = 0; i < d->groupLen[0]; ++i)
+    {
+      if (!off_a1h8(squares[i]))
+        continue;
+      if (off_a1h8(squares[i]) > 0)
+        for (int j = i; j < size; ++j)
+          squares[j] = Square(((squares[j] >> 3) | (squares[j] << 3)) & 63);
+      break;
+    }
+
+    if (e->hasUniquePieces)
+    {
+      int adjust1 = squares[1] > squares[0];
+      int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+      if (off_a1h8(squares[0]))
+        idx = (mapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 +
+              squares[2] - adjust2;
+      else if (off_a1h8(squares[1]))
+        idx = (6 * 63 + rank_of(squares[0]) * 28 + mapB1H1H7[squares[1]]) * 62 +
+              squares[2] - adjust2;
+      else if (off_a1h8(squares[2]))
+        idx = 6 * 63 * 62 + 4 * 28 * 62 + rank_of(squares[0]) * 7 * 28 +
+              (rank_of(squares[1]) - adjust1) * 28 + mapB1H1H7[squares[2]];
+      else
+        idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 +
+              rank_of(squares[0]) * 7 * 6 + (rank_of(squares[1]) - adjust1) * 6 +
+              (rank_of(squares[2]) - adjust2);
+    }
+    else
+      idx = mapKK[mapA1D1D4[squares[0]]][squares[1]];
+  }
+
+  // The other groups, by increasing squares, skipping the ones taken by the
+  // previous groups
+  idx *= d->groupIdx[0];
+  Square *groupSq = squares + d->groupLen[0];
+  bool remainingPawns = e->hasPawns && e->pawnCount[1];
+  for (int next = 1; d->groupLen[next]; ++next)
+  {
+    std::stable_sort(groupSq, groupSq + d->groupLen[next]);
+    uint64_t n = 0;
+    for (int i = 0; i < d->groupLen[next]; ++i)
+    {
+      int adjust = std::count_if(squares, groupSq,
+                                 [&](Square sq) { return groupSq[i] > sq; });
+      n += binomial[i + 1][groupSq[i] - adjust - 8 * remainingPawns];
+    }
+    remainingPawns = false;
+    idx += n * d->groupIdx[next];
+    groupSq += d->groupLen[next];
+  }
+
+  int value = decompress_pairs(d, idx);
+  return type == WDL ? value - 2 : map_dtz(*e, tbFile, value, wdl);
+}
+
+// Tables may store anything for positions with a winning capture, or a loss
+// for a position drawn by a capture, and nothing about en passant. The
+// captures, and the pawn moves for DTZ, are thus searched before the probe.
+WDLScore search(Position &pos, ProbeState &state, bool checkZeroingMoves)
+{
+  WDLScore value, bestValue = WDL_LOSS;
+  Moves moves(&pos);
+  int moveCount = 0;
+  for (ValueMove const &vm : moves)
+  {
+    Move m = vm.m;
+    if (!pos.is_capture(m) &&
+        (!checkZeroingMoves || piece_type_of(pos.piece(get_from(m))) != PAWN))
+      continue;
+    ++moveCount;
+    pos.do_move(m);
+    value = WDLScore(-search(pos, state, false));
+    pos.undo_move();
+    if (state == FAIL)
+      return WDL_DRAW;
+    if (value > bestValue)
+    {
+      bestValue = value;
+      if (value >= WDL_WIN)
+      {
+        state = ZEROING_BEST_MOVE;
+        return value;
+      }
+    }
+  }
+
+  // Nothing to probe if every move was searched
+  bool noMoreMoves = moveCount && moveCount == moves.size();
+  if (noMoreMoves)
+    value = bestValue;
+  else
+  {
+    value = WDLScore(probe_table(pos, WDL, state));
+    if (state == FAIL)
+      return WDL_DRAW;
+  }
+  if (bestValue >= value)
+  {
+    state = bestValue > WDL_DRAW || noMoreMoves ? ZEROING_BEST_MOVE : OK;
+    return bestValue;
+  }
+  state = OK;
+  return value;
+}
+
+inline int dtz_before_zeroing(WDLScore wdl)
+{
+  return wdl == WDL_WIN           ? 1
+         : wdl == WDL_CURSED_WIN   ? 101
+         : wdl == WDL_BLESSED_LOSS ? -101
+         : wdl == WDL_LOSS         ? -1
+                                   : 0;
+}
+
+inline int sign_of(int x) { return (x > 0) - (x < 0); }
+
+// Better moves have a higher rank : MAX_DTZ for the wins within the fifty
+// moves, then MAX_DTZ less the plies to the zeroing move, counting the ones
+// already played. The closer a loss is to a fifty moves draw the better.
+bool rank_by_dtz(Position &pos, std::vector<Move> const &moves,
+                 std::vector<int> &ranks)
+{
+  int cnt50 = pos.rule50_count();
+  ProbeState state = OK;
+  for (size_t i = 0; i < moves.size(); ++i)
+  {
+    pos.do_move(moves[i]);
+    int dtz;
+    if (!pos.rule50_count())
+      dtz = dtz_before_zeroing(WDLScore(-probe_wdl(pos, state)));
+    else if (pos.is_draw())
+      dtz = 0;
+    else
+    {
+      dtz = -probe_dtz(pos, state);
+      dtz += sign_of(dtz);
+    }
+    if (dtz == 2 && pos.in_check() && !Moves(&pos).size())
+      dtz = 1;
+    pos.undo_move();
+    if (state == FAIL)
+      return false;
+    ranks[i] = dtz > 0   ? (dtz + cnt50 <= 99 ? MAX_DTZ : MAX_DTZ - (dtz + cnt50))
+               : dtz < 0 ? (-dtz * 2 + cnt50 < 100 ? -MAX_DTZ
+                                                   : -MAX_DTZ + (-dtz + cnt50))
+                         : 0;
+  }
+  return true;
+}
+
+bool rank_by_wdl(Position &pos, std::vector<Move> const &moves,
+                 std::vector<int> &ranks)
+{
+  constexpr int WDLToRank[] = {-MAX_DTZ, -MAX_DTZ + 101, 0, MAX_DTZ - 101,
+                               MAX_DTZ};
+  ProbeState state = OK;
+  for (size_t i = 0; i < moves.size(); ++i)
+  {
+    pos.do_move(moves[i]);
+    WDLScore wdl = WDLScore(-probe_wdl(pos, state));
+    pos.undo_move();
+    if (state == FAIL)
+      return false;
+    ranks[i] = WDLToRank[wdl + 2];
+  }
+  return true;
+}
+
+// Non-king pieces of a side in decreasing order, like "RBP"
+void piece_sets(std::vector<std::string> &sets, std::string const &prefix,
+                size_t first, int n)
+{
+  sets.push_back(prefix);
+  if (n)
+    for (size_t i = first; i < 5; ++i)
+      piece_sets(sets, prefix + "QRBNP"[i], i, n - 1);
+}
+
+void add(std::string const &code)
+{
+  if (find_file(code + ".rtbw").empty())
+    return;
+  tables.emplace_back(code, WDL);
+  TBTable *wdl = &tables.back();
+  tables.emplace_back(code, DTZ);
+  TBTable *dtz = &tables.back();
+  maxCardinality = std::max(maxCardinality, wdl->pieceCount);
+  tableByKey[wdl->key] = tableByKey[wdl->key2] = {wdl, dtz};
+}
+} // namespace
+
+int Tablebases::init(std::string const &paths)
+{
+  static bool encodingReady = false;
+  if (!encodingReady)
+  {
+    init_encoding();
+    encodingReady = true;
+  }
+  for (TBTable &e : tables)
+    unmap_table(e);
+  tables.clear();
+  tableByKey.clear();
+  tbPaths.clear();
+  maxCardinality = 0;
+  if (paths.empty() || paths == "<empty>")
+    return 0;
+
+  std::istringstream is(paths);
+  std::string dir;
+  while (std::getline(is, dir, ':'))
+    if (!dir.empty())
+      tbPaths.push_back(dir);
+  // Either side may be the stronger one in the file name, both are tried
+  std::vector<std::string> sets;
+  piece_sets(sets, "", 0, TB_PIECES - 2);
+  for (std::string const &w : sets)
+    for (std::string const &b : sets)
+      if (w.size() + b.size() && w.size() + b.size() <= TB_PIECES - 2)
+        add("K" + w + "vK" + b);
+  return tables.size() / 2;
+}
+
+WDLScore Tablebases::probe_wdl(Position &pos, ProbeState &state)
+{
+  state = OK;
+  return search(pos, state, false);
+}
+
+int Tablebases::probe_dtz(Position &pos, ProbeState &state)
+{
+  state = OK;
+  WDLScore wdl = search(pos, state, true);
+  if (state == FAIL || wdl == WDL_DRAW)
+    return 0;
+  // The table holds nothing useful if the best move is a zeroing one
+  if (state == ZEROING_BEST_MOVE)
+    return dtz_before_zeroing(wdl);
+  int dtz = probe_table(pos, DTZ, state, wdl);
+  if (state == FAIL)
+    return 0;
+  if (state != CHANGE_STM)
+    return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) *
+           sign_of(wdl);
+
+  // The table holds the other side to move : best DTZ after one move
+  int minDTZ = 0xFFFF;
+  Moves moves(&pos);
+  for (ValueMove const &vm : moves)
+  {
+    Move m = vm.m;
+    bool zeroing = pos.is_capture(m) || piece_type_of(pos.piece(get_from(m))) == PAWN;
+    pos.do_move(m);
+    dtz = zeroing ? -dtz_before_zeroing(search(pos, state, false))
+                  : -probe_dtz(pos, state);
+    if (dtz == 1 && pos.in_check() && !Moves(&pos).size())
+      minDTZ = 1;
+    if (!zeroing)
+      dtz += sign_of(dtz);
+    if (dtz < minDTZ && sign_of(dtz) == sign_of(wdl))
+      minDTZ = dtz;
+    pos.undo_move();
+    if (state == FAIL)
+      return 0;
+  }
+  return minDTZ == 0xFFFF ? -1 : minDTZ;
+}
+
+bool Tablebases::filter_root_moves(Position &pos, std::vector<Move> &moves,
+                                   Value &score, bool &dtz)
+{
+  if (moves.empty() || popcount(pos.pieces()) > maxCardinality ||
+      pos.can_castle())
+    return false;
+  std::vector<int> ranks(moves.size());
+  dtz = rank_by_dtz(pos, moves, ranks);
+  if (!dtz && !rank_by_wdl(pos, moves, ranks))
+    return false;
+  int best = *std::max_element(ranks.begin(), ranks.end());
+  size_t j = 0;
+  for (size_t i = 0; i < moves.size(); ++i)
+    if (ranks[i] == best)
+      moves[j++] = moves[i];
+  moves.resize(j);
+
+  // The score is on the scale of the search. A win the fifty moves rule
+  // cannot spoil, rank MAX_DTZ - 100 or above, is VALUE_TB_WIN : the score of
+  // a tablebase win at ply 0 in the search, that print_info shows unless the
+  // search finds a mate. A cursed win or a blessed loss, a draw for the
+  // search, is a fraction of a pawn from 1/2 down to 3/200, smaller as the
+  // zeroing move gets further past the fifty moves.
+  int bound = MAX_DTZ - 100;
+  score = best >= bound    ? VALUE_TB_WIN
+          : best > 0       ? Value(std::max(3, best - (MAX_DTZ - 200)) * PawnValue / 200)
+          : best == 0      ? VALUE_DRAW
+          : best > -bound  ? Value(std::min(-3, best + (MAX_DTZ - 200)) * PawnValue / 200)
+                           : Value(-VALUE_TB_WIN);
+  return true;
+}
@@ -0,0 +1,51 @@
+#ifndef TBPROBE_INCLUDED
+#define TBPROBE_INCLUDED
+#include "types.hpp"
+#include <string>
+#include <vector>
+
+class Position;
+
+// Syzygy endgame tablebases. The files are mapped the first time a table is
+// probed, and can then be probed by every thread at once.
+namespace Tablebases
+{
+enum WDLScore
+{
+  WDL_LOSS = -2,
+  WDL_BLESSED_LOSS = -1, // loss, but a draw by the fifty moves rule
+  WDL_DRAW = 0,
+  WDL_CURSED_WIN = 1, // win, but a draw by the fifty moves rule
+  WDL_WIN = 2
+};
+
+enum ProbeState
+{
+  FAIL = 0,
+  OK = 1,
+  CHANGE_STM = -1,      // the DTZ table holds the other side to move
+  ZEROING_BEST_MOVE = 2 // the best move is a capture or a pawn move
+};
+
+// Most pieces of the tables found, 0 if there is none
+extern int maxCardinality;
+
+// Registers the tables of the directories of a list separated by ':', after
+// zobrist_init() and bitboard_init(). Previous tables are released. Returns
+// the number of tables found.
+int init(std::string const &paths);
+// Win, draw or loss for the side to move. The position must have no
+// castling right.
+WDLScore probe_wdl(Position &pos, ProbeState &state);
+// Plies to the next capture or pawn move, with the sign of the WDL result :
+// 1 for a win by a zeroing move, 101 for a cursed one and 0 for a draw
+int probe_dtz(Position &pos, ProbeState &state);
+// Keeps the root moves that best preserve the result, ranked by DTZ when the
+// tables are there, else by WDL. Returns false if the root cannot be probed,
+// the moves are then untouched. score is the value to report, and dtz tells
+// which tables were used.
+bool filter_root_moves(Position &pos, std::vector<Move> &moves, Value &score,
+                       bool &dtz);
+} // namespace Tablebases
+
+#endif
@@ -1,83 +1,206 @@
-#include "threads.hpp"
-#include "misc.hpp"
-#include "options.hpp"
-#include <iostream>
-
-ThreadPool Threads;
-
-void ThreadPool::init()
-{
-  if (threads.size() != 0)
-    stop_search();
-  Option &o = Options["Threads"];
-  size_t nbThread = (int)o;
-  if (nbThread == threads.size())
-    return;
-  threads.clear();
-  threads.reserve(nbThread);
-  for (size_t i = 0; i < nbThread; i++)
-    threads.emplace_back(i);
-}
-
-void ThreadPool::start_searching()
-{
-  stop = false;
-  threads[0].start_searching();
-  return;
-}
-
-void Thread::idle()
-{
-  searching = false;
-  cv.notify_one();
-  while (!Threads.terminate_thread)
-  {
-    std::unique_lock<std::mutex> lk(m);
-    cv.wait(lk,
-            [this]() { return this->searching || Threads.terminate_thread; });
-    if (searching)
-      search(); // will not search if Threads.stop
-    searching = false;
-    cv.notify_one();
-  }
-}
-
-// should not happen, but the compiler doesn't know it
-__attribute__((noreturn))
-Thread::Thread(Thread &&t __attribute__((unused))) noexcept
-{
-  exit(-1);
-}
-
-void Thread::wait_for_search_finished()
-{
-  if (searching)
-  {
-    std::unique_lock<std::mutex> lk(m);
-    cv.wait(lk, [this]() { return !this->searching; });
-  }
-}
-
-void Thread::start_searching()
-{
-  wait_for_search_finished();
-  searching = true;
-  cv.notify_one();
-}
-
-Thread::Thread(int _idx)
-    : pos(), std_thread{&Thread::idle, this}, searching(false), idx(_idx) {}
-
-Thread::~Thread() noexcept
-{
-  if (std_thread.joinable())
-  {
-    std_thread.join();
-  }
-}
-void ThreadPool::setPosition(Position &&pos)
-{
-  assert(threads.size() != 0);
-  threads[0].wait_for_search_finished();
-  threads[0].setPosition(std::forward<Position>(pos));
-}
+#include "threads.hpp"
+#include "misc.hpp"
+#include "options.hpp"
+#include "tt.hpp"
+#include <iostream>
+#include <map>
+
+ThreadPool Threads;
+
+void ThreadPool::init()
+{
+  if (threads.size() != 0)
+    stop_search();
+  Option &o = Options["Threads"];
+  size_t nbThread = (int)o;
+  if (nbThread == threads.size())
+    return;
+  Position pos;
+  if (threads.size() != 0)
+    pos = threads[0].pos;
+  threads.clear();
+  threads.reserve(nbThread);
+  for (size_t i = 0; i < nbThread; i++)
+    threads.emplace_back(i);
+  threads[0].setPosition(pos);
+}
+
+// Lazy SMP : every thread searches the same root, the main thread waits for
+// the helpers once it is done and reports the move they agree on.
+void ThreadPool::start_searching(SearchLimits const &searchLimits,
+                                 bool ponderSearch)
+{
+  threads[0].wait_for_search_finished();
+  stop = false;
+  ponder = ponderSearch;
+  stopOnPonderhit = false;
+  limits = searchLimits;
+  Time.init(limits, threads[0].pos.side_to_move(), threads[0].pos.game_ply());
+  TT.new_search();
+  for (size_t i = 1; i < threads.size(); ++i)
+    threads[i].setPosition(threads[0].pos);
+  for (size_t i = 1; i < threads.size(); ++i)
+    threads[i].start_searching();
+  threads[0].start_searching();
+}
+
+void ThreadPool::request_stop()
+{
+  {
+    std::lock_guard<std::mutex> lk(stopMutex);
+    stop = true;
+  }
+  stopCv.notify_all();
+}
+
+void ThreadPool::wait_for_stop()
+{
+  std::unique_lock<std::mutex> lk(stopMutex);
+  stopCv.wait(lk, [this]() { return stop || (!ponder && !limits.infinite); });
+}
+
+// The opponent played the expected move : the search goes on with the time
+// it was given, and the time spent pondering counts as used
+void ThreadPool::ponderhit()
+{
+  {
+    std::lock_guard<std::mutex> lk(stopMutex);
+    ponder = false;
+    if (stopOnPonderhit)
+      stop = true;
+  }
+  stopCv.notify_all();
+}
+
+// Runs f(idx) on every thread of the pool and waits for all of them
+void ThreadPool::run_on_all(std::function<void(size_t)> const &f)
+{
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].execute([&f, i]() { f(i); });
+  for (Thread &th : threads)
+    th.wait_for_search_finished();
+}
+
+// New game : entries of the previous games get replaced first
+void ThreadPool::reset()
+{
+  stop_search();
+  TT.new_search();
+}
+
+uint64_t ThreadPool::nodes_searched() const
+{
+  uint64_t nodes = 0;
+  for (Thread const &th : threads)
+    nodes += th.nodes_searched();
+  return nodes;
+}
+
+uint64_t ThreadPool::tb_hits() const
+{
+  uint64_t hits = 0;
+  for (Thread const &th : threads)
+    hits += th.tb_hits();
+  return hits;
+}
+
+// Each thread votes for its best move, weighted by the depth it completed and
+// by how its score compares to the other threads.
+Thread *ThreadPool::best_thread()
+{
+  Thread *best = &threads[0];
+  std::map<Move, int64_t> votes;
+  Value minScore = VALUE_INFINITE;
+  for (Thread &th : threads)
+    if (th.completedDepth)
+      minScore = std::min(minScore, th.rootValue);
+  for (Thread &th : threads)
+    if (th.completedDepth)
+      votes[th.rootMove] +=
+          int64_t(th.rootValue - minScore + 14) * th.completedDepth;
+  for (Thread &th : threads)
+    if (th.completedDepth &&
+        (votes[th.rootMove] > votes[best->rootMove] ||
+         (votes[th.rootMove] == votes[best->rootMove] &&
+          th.completedDepth > best->completedDepth)))
+      best = &th;
+  return best;
+}
+
+void Thread::idle()
+{
+  while (true)
+  {
+    std::unique_lock<std::mutex> lk(m);
+    cv.wait(lk, [this]() { return this->searching || this->exit; });
+    if (exit)
+      return;
+    lk.unlock();
+    if (job)
+      job();
+    else
+      search(); // will not search if Threads.stop
+    lk.lock();
+    job = nullptr;
+    searching = false;
+    cv.notify_all();
+  }
+}
+
+// should not happen, but the compiler doesn't know it
+__attribute__((noreturn))
+Thread::Thread(Thread &&t __attribute__((unused))) noexcept
+{
+  std::exit(-1);
+}
+
+void Thread::wait_for_search_finished()
+{
+  std::unique_lock<std::mutex> lk(m);
+  cv.wait(lk, [this]() { return !this->searching; });
+}
+
+void Thread::start_searching()
+{
+  wait_for_search_finished();
+  {
+    std::lock_guard<std::mutex> lk(m);
+    searching = true;
+  }
+  cv.notify_all();
+}
+
+void Thread::execute(std::function<void()> const &f)
+{
+  wait_for_search_finished();
+  {
+    std::lock_guard<std::mutex> lk(m);
+    job = f;
+    searching = true;
+  }
+  cv.notify_all();
+}
+
+Thread::Thread(int _idx)
+    : pos(), pawnTable(PAWN_TABLE_MB), materialTable(MATERIAL_TABLE_MB),
+      completedDepth(0), single(false), nodes(0), tbHits(0), searching(false),
+      exit(false), idx(_idx), std_thread{&Thread::idle, this} {}
+
+Thread::~Thread() noexcept
+{
+  {
+    std::lock_guard<std::mutex> lk(m);
+    exit = true;
+  }
+  cv.notify_all();
+  if (std_thread.joinable())
+  {
+    std_thread.join();
+  }
+}
+void ThreadPool::setPosition(Position &&pos)
+{
+  assert(threads.size() != 0);
+  threads[0].wait_for_search_finished();
+  threads[0].setPosition(pos);
+}
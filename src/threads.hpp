@@ -1,59 +1,187 @@
-#ifndef THREADS_DEFINED
-#define THREADS_DEFINED
-#include "position.hpp"
-#include <atomic>
-#include <condition_variable>
-#include <thread>
-#include <vector>
-
-class Thread {
-public:
-  Thread(int idx);
-  Thread() = delete;
-  Thread(Thread &&) noexcept;
-  ~Thread() noexcept;
-  void idle();
-  void search();
-  void start_searching();
-  void notify() { cv.notify_one(); }
-  void wait_for_search_finished();
-  inline void setPosition(Position &&_pos) { pos = std::move(_pos); }
-
-private:
-  Position pos;
-  std::condition_variable cv;
-  std::thread std_thread;
-  std::atomic_bool searching;
-  std::mutex m;
-  int idx; // thread index, 0 if main thread
-};
-
-class ThreadPool {
-  friend class Thread;
-
-public:
-  ThreadPool() = default;
-  inline void stop_search() noexcept {
-    stop = true;
-    threads[0].wait_for_search_finished();
-    stop = false;
-  }
-  inline void terminate() noexcept {
-    terminate_thread = true;
-    stop = true;
-    threads[0].notify();
-  }
-  void setPosition(Position &&position);
-  void start_searching();
-  inline void reset() {}
-  void init();
-  ~ThreadPool() = default;
-
-private:
-  std::vector<Thread> threads;
-  std::atomic_bool stop, terminate_thread;
-};
-
-extern ThreadPool Threads;
-
-#endif
+#ifndef THREADS_DEFINED
+#define THREADS_DEFINED
+#include "moves.hpp"
+#include "position.hpp"
+#include "timeman.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Nodes between two reads of the stop flag
+constexpr int POLL_NODES = 256;
+
+// A move of the root and what the search found for it. The list is kept
+// sorted, so that its first MultiPV moves are the lines to report.
+struct RootMove {
+  explicit RootMove(Move m) : move(m), pv(1, m) {}
+  inline bool operator==(Move m) const { return move == m; }
+  // Best first, ties broken by the previous iteration
+  inline bool operator<(RootMove const &rm) const {
+    return rm.score != score ? rm.score < score
+                             : rm.previousScore < previousScore;
+  }
+
+  Move move;
+  // -VALUE_INFINITE when the move did not raise alpha
+  Value score = -VALUE_INFINITE, previousScore = -VALUE_INFINITE;
+  int selDepth = 0;
+  uint64_t nodes = 0; // spent on the move, for the time management
+  std::vector<Move> pv;
+};
+
+class Thread {
+  friend class ThreadPool;
+
+public:
+  Thread(int idx);
+  Thread() = delete;
+  Thread(Thread &&) noexcept;
+  ~Thread() noexcept;
+  void idle();
+  void search();
+  void start_searching();
+  void execute(std::function<void()> const &f);
+  void wait_for_search_finished();
+  inline void setPosition(Position const &_pos) { pos = _pos; }
+  inline uint64_t nodes_searched() const {
+    return nodes.load(std::memory_order_relaxed);
+  }
+  inline uint64_t tb_hits() const {
+    return tbHits.load(std::memory_order_relaxed);
+  }
+  inline int completed_depth() const { return completedDepth; }
+  // Searches a position alone, on the calling thread, with the limits of the
+  // pool and without output. Returns the score and the principal variation.
+  Value analyse(Position const &position, std::vector<Move> &line);
+
+private:
+  template <bool PvNode>
+  Value alpha_beta(Value alpha, Value beta, int depth, int ply);
+  template <bool PvNode>
+  Value quiescence(Value alpha, Value beta, int depth, int ply);
+  void update_quiet_stats(int ply, int depth, Move move, Move const *quiets,
+                          int quietCount);
+  void update_pv(int ply, Move m);
+  void print_info(int depth, Value alpha, Value beta) const;
+  void poll();
+  // Reports and manages the time of the pool's search
+  inline bool main_thread() const { return idx == 0 && !single; }
+  // Only the owning thread writes the counter, no need for a locked add
+  inline void count_node() {
+    nodes.store(nodes.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    if (--callsCnt <= 0)
+      poll();
+  }
+
+  Position pos;
+  // Triangular table : pv[ply] holds the principal variation from ply on
+  Move pv[MAX_PLY + 1][MAX_PLY + 1];
+  int pvLength[MAX_PLY + 1];
+  Move killers[MAX_PLY][2];
+  History history;
+  PawnTable pawnTable;
+  MaterialTable materialTable;
+  std::vector<RootMove> rootMoves; // the ones searched, see tbprobe.hpp
+  size_t multiPV, pvIdx; // lines searched, and the one being searched
+  Move pvMove;           // best move of the line in the previous iteration
+  std::vector<Move> rootPv; // principal variation of the last iteration
+  Move rootMove;            // best move of the last completed iteration
+  Value rootValue;          // and its score
+  int completedDepth;
+  double bestMoveChanges; // since the last iterations, halved at each one
+  int callsCnt;           // nodes until the next poll()
+  bool stopped;           // Threads.stop as of the last poll()
+  bool single;            // searching alone, see analyse()
+  std::atomic<uint64_t> nodes, tbHits;
+  int tbCardinality; // most pieces probed in the search, 0 for none
+  int tbProbeDepth;
+  Value tbScore; // result of the root in the tablebases, VALUE_NONE if none
+  int selDepth;
+  std::chrono::steady_clock::time_point startTime;
+  std::function<void()> job; // run by idle() instead of the search if set
+  std::condition_variable cv;
+  std::atomic_bool searching, exit;
+  std::mutex m;
+  int idx; // thread index, 0 if main thread
+  std::thread std_thread; // last, so that idle() sees a constructed object
+};
+
+// Limits of a search, 0 when not set
+struct SearchLimits {
+  inline bool use_time_management() const {
+    return time[WHITE] || time[BLACK];
+  }
+
+  TimePoint time[NB_COLOR] = {}, inc[NB_COLOR] = {}, movetime = 0;
+  int movestogo = 0, depth = 0;
+  uint64_t nodes = 0;
+  bool infinite = false;
+  // when the go command was received
+  std::chrono::steady_clock::time_point startTime =
+      std::chrono::steady_clock::now();
+};
+
+class ThreadPool {
+  friend class Thread;
+
+public:
+  ThreadPool() = default;
+  inline void stop_search() noexcept {
+    request_stop();
+    threads[0].wait_for_search_finished();
+    stop = false;
+  }
+  inline void terminate() noexcept {
+    request_stop();
+    threads[0].wait_for_search_finished();
+  }
+  // Does not wait for the search to end, safe from any thread
+  void request_stop();
+  void wait_for_stop();
+  void ponderhit();
+  void setPosition(Position &&position);
+  inline Position const &position() const { return threads[0].pos; }
+  // While pondering, the search ignores its time limits until ponderhit()
+  void start_searching(SearchLimits const &searchLimits = SearchLimits(),
+                       bool ponderSearch = false);
+  inline void wait_for_search_finished() {
+    threads[0].wait_for_search_finished();
+  }
+  void reset();
+  void init();
+  void run_on_all(std::function<void(size_t)> const &f);
+  inline size_t size() const { return threads.size(); }
+  inline Thread &operator[](size_t i) { return threads[i]; }
+  uint64_t nodes_searched() const;
+  uint64_t tb_hits() const;
+  ~ThreadPool() = default;
+
+  SearchLimits limits;
+
+private:
+  Thread *best_thread();
+
+  std::vector<Thread> threads;
+  std::atomic_bool stop;
+  // pondering, and whether the search ran out of time doing it
+  std::atomic_bool ponder, stopOnPonderhit;
+  std::mutex stopMutex;
+  std::condition_variable stopCv;
+};
+
+extern ThreadPool Threads;
+
+namespace Batch {
+// Streams the positions of an EPD or FEN file to the threads of the pool,
+// each one searching its own position alone, and writes a line per position
+// to the output file, in the order of the input. Returns false if a file
+// cannot be opened.
+bool analyse(std::string const &input, std::string const &output,
+             SearchLimits const &limits);
+} // namespace Batch
+
+#endif
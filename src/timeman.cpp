@@ -0,0 +1,52 @@
+#include "timeman.hpp"
+#include "options.hpp"
+#include "threads.hpp"
+#include <algorithm>
+
+TimeManager Time;
+
+// With nodestime set, the clock is converted to nodes at that many nodes per
+// millisecond, so that games are reproducible whatever the load of the
+// machine
+void TimeManager::init(SearchLimits &limits, Color us, int ply)
+{
+  startTime = limits.startTime;
+  nodesPerMs = Options["nodestime"];
+  TimePoint overhead = (int)Options["MoveOverhead"];
+  if (nodesPerMs)
+  {
+    limits.time[us] *= nodesPerMs;
+    limits.inc[us] *= nodesPerMs;
+    limits.movetime *= nodesPerMs;
+    overhead *= nodesPerMs;
+  }
+  if (limits.movetime)
+  {
+    optimumTime = maximumTime =
+        std::max<TimePoint>(1, limits.movetime - overhead);
+    return;
+  }
+  if (!limits.use_time_management())
+    return;
+
+  // The remaining time is spread over the moves to go, and the overhead is
+  // paid on each of them. Early moves get a bit less, the game may be long.
+  TimePoint time = limits.time[us], inc = limits.inc[us];
+  int mtg = limits.movestogo ? std::min(limits.movestogo, 50) : 40;
+  TimePoint left =
+      std::max<TimePoint>(1, time + inc * (mtg - 1) - overhead * (2 + mtg));
+  double share = std::min(1.0, 0.8 + ply / 100.0) / mtg;
+  optimumTime = std::max<TimePoint>(1, TimePoint(left * share));
+  maximumTime = std::max<TimePoint>(
+      1, std::min(5 * optimumTime, time * 8 / 10 - overhead));
+  optimumTime = std::min(optimumTime, maximumTime);
+}
+
+TimePoint TimeManager::elapsed() const
+{
+  if (nodesPerMs)
+    return Threads.nodes_searched();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - startTime)
+      .count();
+}
@@ -0,0 +1,30 @@
+#ifndef TIMEMAN_INCLUDED
+#define TIMEMAN_INCLUDED
+#include "types.hpp"
+#include <chrono>
+#include <cstdint>
+
+struct SearchLimits;
+
+// Milliseconds, or nodes when the time is counted in nodes
+using TimePoint = int64_t;
+
+// Time allotted to a move : the search aims at the optimum, scaled by how
+// stable its result is, and never goes beyond the maximum
+class TimeManager
+{
+public:
+  void init(SearchLimits &limits, Color us, int ply);
+  inline TimePoint optimum() const { return optimumTime; }
+  inline TimePoint maximum() const { return maximumTime; }
+  TimePoint elapsed() const;
+
+private:
+  std::chrono::steady_clock::time_point startTime;
+  TimePoint optimumTime, maximumTime;
+  int nodesPerMs; // 0 unless the time is counted in nodes
+};
+
+extern TimeManager Time;
+
+#endif
@@ -0,0 +1,72 @@
+#include "tt.hpp"
+#include "threads.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <sys/mman.h>
+
+namespace
+{
+constexpr size_t hugePageSize = 2 * 1024 * 1024;
+// Below this size, clearing is faster than waking up the pool
+constexpr size_t parallelClearSize = 64 * 1024 * 1024;
+} // namespace
+
+// Tables are allocated on 2MB pages to avoid TLB misses on every probe :
+// explicit huge pages when some are reserved (MAP_HUGETLB), transparent huge
+// pages otherwise.
+void *large_alloc(size_t size, bool &mapped)
+{
+  size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+  void *mem = nullptr;
+  mapped = false;
+#ifdef MAP_HUGETLB
+  mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem != MAP_FAILED)
+  {
+    mapped = true;
+    return mem;
+  }
+#endif
+  mem = std::aligned_alloc(hugePageSize, size);
+  if (mem == nullptr)
+  {
+    std::cerr << "Failed to allocate " << size / (1024 * 1024)
+              << "MB for a hash table" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(mem, size, MADV_HUGEPAGE);
+#endif
+  return mem;
+}
+
+void large_free(void *mem, size_t size, bool mapped)
+{
+  size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+  if (mapped)
+    munmap(mem, size);
+  else
+    std::free(mem);
+}
+
+// Every thread of the pool zeroes its own slice. Since pages are only
+// backed on first touch, each slice also lands on the NUMA node of the
+// thread that will probe it the most.
+void parallel_clear(void *mem, size_t size)
+{
+  size_t nbThread = Threads.size();
+  if (size < parallelClearSize || nbThread < 2)
+  {
+    std::memset(mem, 0, size);
+    return;
+  }
+  size_t chunk = (size / nbThread + hugePageSize - 1) / hugePageSize *
+                 hugePageSize;
+  Threads.run_on_all([mem, size, chunk](size_t idx) {
+    size_t start = idx * chunk;
+    if (start < size)
+      std::memset(static_cast<char *>(mem) + start, 0,
+                  std::min(chunk, size - start));
+  });
+}
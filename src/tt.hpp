@@ -1,89 +1,239 @@
-#ifndef TT_INCLUDED
-#define TT_INCLUDED
-#include "types.hpp"
-#include <cstring>
-
-template <typename Entry>
-class HashTable
-{
-public:
-  HashTable() : table(nullptr), tableSize(0) {}
-  HashTable(size_t nMB) { resize(nMB); }
-  virtual ~HashTable()
-  {
-    if (table != nullptr)
-      delete[] table;
-  }
-  void resize(size_t nMB)
-  {
-    tableSize = nMB * (1024 * 1024 / cacheLineSize);
-    assert(tableSize <= (1ULL << 32));
-    if (table != nullptr)
-      delete[] table;
-    table = new Bucket[tableSize];
-    clear();
-  }
-  void clear() { std::memset(table, 0, tableSize * sizeof(Bucket)); }
-  Entry *probe(Key key, bool &hit) const
-  {
-    Bucket *b = bucket(key);
-    Entry *ret = nullptr;
-    int replacementPriority = -1;
-    for (size_t i = 0; i < bucketSize; ++i)
-    {
-      if (b->key(i) == key)
-      {
-        hit = true;
-        return &(*b)[i];
-      }
-      if (b->priority(i) > replacementPriority)
-      {
-        replacementPriority = b->priority(i);
-        ret = &(*b)[i];
-      }
-    }
-    hit = false;
-    return ret;
-  }
-  int hashfull() const
-  {
-    assert(1000 / bucketSize < tableSize);
-    int hashfull = 0;
-    for (int i = 1; i < 1000 / bucketSize + 1; ++i)
-    {
-      Bucket *b = table + i;
-      for (int j = 0; j < bucketSize; ++j)
-        if (b[i].key)
-          hashfull++;
-    }
-    return hashfull;
-  } // estimates fullness
-
-private:
-  static constexpr size_t cacheLineSize = 64;
-  static constexpr size_t bucketSize = cacheLineSize / sizeof(Entry);
-
-  struct Bucket
-  {
-    Entry entry[bucketSize];
-    inline Entry &operator[](size_t i) { return entry[i]; }
-    inline Key key(size_t i) const { return entry[i].key; }
-    inline int priority(size_t i) const { return entry[i].priority(); }
-  } __attribute__((aligned(cacheLineSize)));
-  inline Bucket *bucket(Key key) const
-  {
-    return table + (((key & 0xffffffffULL) * (tableSize - 1)) >> 32);
-  }
-  Bucket *table;
-  size_t tableSize;
-};
-
-struct PerftEntry
-{
-  Key key;
-  uint64_t perft;
-  Depth depth;
-  inline int priority() const { return depth; }
-} __attribute__((packed));
-
+#ifndef TT_INCLUDED
+#define TT_INCLUDED
+#include "types.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+// Memory for large tables, see tt.cpp
+void *large_alloc(size_t size, bool &mapped);
+void large_free(void *mem, size_t size, bool mapped);
+void parallel_clear(void *mem, size_t size);
+
+template <typename Entry>
+class HashTable
+{
+public:
+  HashTable() : table(nullptr), tableSize(0) {}
+  HashTable(size_t nMB) : table(nullptr), tableSize(0) { resize(nMB); }
+  virtual ~HashTable()
+  {
+    if (table != nullptr)
+      large_free(table, tableSize * sizeof(Bucket), mapped);
+  }
+  void resize(size_t nMB)
+  {
+    if (table != nullptr)
+      large_free(table, tableSize * sizeof(Bucket), mapped);
+    tableSize = nMB * (1024 * 1024 / cacheLineSize);
+    assert(tableSize <= (1ULL << 32));
+    table = static_cast<Bucket *>(
+        large_alloc(tableSize * sizeof(Bucket), mapped));
+    clear();
+  }
+  void clear() { parallel_clear(table, tableSize * sizeof(Bucket)); }
+  // Lockless probe : the matching entry is copied to `entry` before being
+  // checked, so that a concurrent write cannot change it once validated.
+  // Returns the slot of the matching entry, or the one to replace : the
+  // lowest priority, which is the depth minus a penalty for old generations.
+  Entry *probe(Key key, Entry &entry, bool &hit) const
+  {
+    Bucket *b = bucket(key);
+    Entry *ret = nullptr;
+    int replacementPriority = std::numeric_limits<int>::max();
+    for (size_t i = 0; i < bucketSize; ++i)
+    {
+      entry = (*b)[i];
+      if (entry.match(key))
+      {
+        hit = true;
+        // Entries still in use are moved to the current generation
+        if (!entry.is_current(generation8))
+        {
+          entry.refresh(key, generation8);
+          (*b)[i] = entry;
+        }
+        return &(*b)[i];
+      }
+      int priority = entry.priority(generation8);
+      if (priority < replacementPriority)
+      {
+        replacementPriority = priority;
+        ret = &(*b)[i];
+      }
+    }
+    hit = false;
+    return ret;
+  }
+  // Probe of a table owned by a single thread, such as the pawn and material
+  // tables : nothing can write the entries concurrently, so they are used in
+  // place instead of being copied. Same slots as probe().
+  Entry *probe_local(Key key, bool &hit) const
+  {
+    Bucket *b = bucket(key);
+    Entry *ret = nullptr;
+    int replacementPriority = std::numeric_limits<int>::max();
+    for (size_t i = 0; i < bucketSize; ++i)
+    {
+      Entry &entry = (*b)[i];
+      if (entry.match(key))
+      {
+        hit = true;
+        if (!entry.is_current(generation8))
+          entry.refresh(key, generation8);
+        return &entry;
+      }
+      int priority = entry.priority(generation8);
+      if (priority < replacementPriority)
+      {
+        replacementPriority = priority;
+        ret = &entry;
+      }
+    }
+    hit = false;
+    return ret;
+  }
+  // Address of the bucket of a key, and a prefetch of it to hide the memory
+  // latency of the following probe
+  inline void const *address_of(Key key) const { return bucket(key); }
+  inline void prefetch(Key key) const { __builtin_prefetch(bucket(key)); }
+  // Ages every entry in O(1), to be called for each new search or game
+  void new_search() { ++generation8; }
+  uint8_t generation() const { return generation8; }
+  // Permill of the table used by the current generation, estimated on the
+  // first buckets
+  int hashfull() const
+  {
+    size_t sampled = std::min<size_t>(1000 / bucketSize, tableSize);
+    size_t used = 0;
+    for (size_t i = 0; i < sampled; ++i)
+      for (size_t j = 0; j < bucketSize; ++j)
+        used += table[i].entry[j].is_current(generation8);
+    return used * 1000 / (sampled * bucketSize);
+  }
+
+private:
+  static constexpr size_t cacheLineSize = 64;
+  static constexpr size_t bucketSize = cacheLineSize / sizeof(Entry);
+
+  struct Bucket
+  {
+    Entry entry[bucketSize];
+    inline Entry &operator[](size_t i) { return entry[i]; }
+  } __attribute__((aligned(cacheLineSize)));
+  inline Bucket *bucket(Key key) const
+  {
+    return table + (((key & 0xffffffffULL) * (tableSize - 1)) >> 32);
+  }
+  Bucket *table;
+  size_t tableSize;
+  bool mapped; // allocated with MAP_HUGETLB
+  uint8_t generation8 = 0;
+};
+
+// Perft entry, shared by the perft threads without locks. The data packs
+// the node count (48 bits), the generation and the depth. The key is stored
+// xored with it so that a torn entry does not match.
+struct PerftEntry
+{
+  inline uint64_t perft() const { return data >> 16; }
+  inline Depth depth() const { return Depth(data & 0xff); }
+  inline uint8_t generation() const { return uint8_t(data >> 8); }
+
+  inline bool match(Key k) const { return data && (keyCheck ^ data) == k; }
+  inline bool is_current(uint8_t gen) const
+  {
+    return data && generation() == gen;
+  }
+  inline void refresh(Key k, uint8_t gen) { save(k, perft(), depth(), gen); }
+  inline int priority(uint8_t gen) const
+  {
+    return depth() - 8 * uint8_t(gen - generation());
+  }
+  void save(Key k, uint64_t nodes, Depth d, uint8_t gen)
+  {
+    uint64_t newData = nodes << 16 | uint64_t(gen) << 8 | d;
+    data = newData;
+    keyCheck = k ^ newData;
+  }
+
+private:
+  Key keyCheck;
+  uint64_t data;
+};
+
+enum Bound : uint8_t
+{
+  BOUND_NONE,
+  BOUND_UPPER,
+  BOUND_LOWER,
+  BOUND_EXACT = BOUND_UPPER | BOUND_LOWER
+};
+
+// Search entry, 10 bytes so that 6 of them fit in a bucket.
+// The data is packed in 64 bits :
+//    0-15 : move
+//   16-31 : value
+//   32-47 : static evaluation
+//   48-55 : depth + DEPTH_OFFSET
+//   56-57 : bound
+//   58-63 : generation
+// Threads read and write entries without locks. The stored key check is
+// xored with a fold of the data, so that an entry torn between two writers
+// does not match any key (but with a 2^-16 probability).
+struct TTEntry
+{
+  static constexpr int DEPTH_OFFSET = 8;
+
+  inline Move move() const { return Move(data); }
+  inline Value value() const { return Value(data >> 16); }
+  inline Value eval() const { return Value(data >> 32); }
+  inline int depth() const { return int((data >> 48) & 0xff) - DEPTH_OFFSET; }
+  inline Bound bound() const { return Bound((data >> 56) & 0x3); }
+  inline uint8_t generation() const { return uint8_t(data >> 58); }
+
+  inline bool match(Key k) const
+  {
+    return data && (keyCheck ^ fold(data)) == k >> 48;
+  }
+  inline bool is_current(uint8_t gen) const
+  {
+    return data && generation() == (gen & 0x3f);
+  }
+  inline int priority(uint8_t gen) const
+  {
+    return depth() - 8 * ((gen - generation()) & 0x3f);
+  }
+
+  inline void refresh(Key k, uint8_t gen)
+  {
+    save(k, value(), bound(), depth(), move(), eval(), gen);
+  }
+
+  void save(Key k, Value v, Bound b, int d, Move m, Value ev, uint8_t gen)
+  {
+    // Keep the previous move if none is provided for the same position
+    if (!m && match(k))
+      m = move();
+    uint64_t newData = uint64_t(m) | uint64_t(uint16_t(v)) << 16 |
+                       uint64_t(uint16_t(ev)) << 32 |
+                       uint64_t(uint8_t(d + DEPTH_OFFSET)) << 48 |
+                       uint64_t(b) << 56 | uint64_t(gen & 0x3f) << 58;
+    data = newData;
+    keyCheck = uint16_t(k >> 48) ^ fold(newData);
+  }
+
+private:
+  static inline uint16_t fold(uint64_t d)
+  {
+    return uint16_t(d ^ (d >> 16) ^ (d >> 32) ^ (d >> 48));
+  }
+
+  uint16_t keyCheck;
+  uint64_t data;
+} __attribute__((packed));
+
+extern HashTable<TTEntry> TT;
+
 #endif
\ No newline at end of file
@@ -1,131 +1,351 @@
-#include "bitboards.hpp"
-#include "misc.hpp"
-#include "options.hpp"
-#include "threads.hpp"
-#include "types.hpp"
-#include <fstream>
-#include <iostream>
-#include <sstream>
-#include <string>
-
-void engine_init();
-
-namespace UCI {
-std::string engine_info();
-std::string bench();
-void position(std::istream &);
-void set_option(std::istream &is);
-void go();
-} // namespace UCI
-
-int main(int argc, char **argv) {
-  std::string cmd, token;
-  std::istringstream is;
-  // initialisation of the engine
-  engine_init();
-  // UCI Loop
-  // Only this thread will use std::cin, so it doesn't need synchonisation, as
-  // opposed to std::cout. cin is tied to cout, it will wait for it to unlocked
-  // anyway.
-  // accepts one commands from argument.
-  for (int i = 1; i < argc; ++i)
-    cmd += std::string(argv[i]) + ' ';
-  is.str(cmd);
-  while (token != "quit") {
-    is >> token;
-    if (is.eof()) {
-      getline(std::cin, cmd);
-      is.clear();
-      is.str(cmd);
-      is >> token;
-    }
-    if (token == "uci")
-      std::cout << Sync::lock << UCI::engine_info() << Options << "uciok\n"
-                << Sync::unlock;
-    else if (token == "isready")
-      std::cout << Sync::lock << "readyok\n" << Sync::unlock;
-    else if (token == "ucinewgame")
-      Threads.reset();
-    else if (token == "position")
-      UCI::position(is);
-    else if (token == "bench")
-      std::cout << Sync::lock << UCI::bench() << '\n' << Sync::unlock;
-    else if (token == "go")
-      UCI::go();
-    else if (token == "debug") {
-      is >> token;
-      if (token == "on")
-        Options["debug"].setValue(true);
-      else
-        Options["debug"].setValue(false);
-    } else if (token == "setoption") {
-      Threads.stop_search();
-      UCI::set_option(is);
-    } else if (token == "stop")
-      Threads.stop_search();
-    else if (token == "ponderhit")
-      ; // TODO
-    else if (token == "perft" || token == "bench") {
-      Perft::perft();
-      Threads.terminate();
-      token = "quit";
-    } else if (token == "quit") {
-      Threads.terminate();
-    }
-  }
-  return 0;
-}
-
-namespace UCI {
-std::string engine_info() { return "id name Kitty\nid author Loli\n"; }
-std::string bench() { return "Time : 1000\nNodes : 0\nNPS : 2000000\n"; }
-void position(std::istream &is) {
-  std::string cmd, fen, move;
-  Position pos;
-  is >> cmd;
-  if (cmd == "startpos") {
-    pos.set_position(startfen);
-    if (!is.eof())
-      is >> move;
-  } else if (cmd == "fen") {
-    is >> fen;
-    std::string temp;
-    while (!is.eof() && temp != "moves") {
-      is >> temp;
-      fen += ' ' + temp;
-    }
-    pos.set_position(fen);
-  }
-  while (!is.eof()) {
-    is >> move;
-    pos.do_move(move);
-  }
-  pos.rebase_stack();
-  Threads.setPosition(std::move(pos));
-}
-} // namespace UCI
-
-void UCI::set_option(std::istream &is) {
-  std::string token, name, value;
-  while (!is.eof() && token != "name")
-    is >> token; // consumes "name"
-  while (!is.eof()) {
-    is >> token;
-    if (token == "value")
-      break;
-    else
-      name += token;
-  }
-  while (!is.eof()) {
-    is >> token;
-    value += token;
-  }
-  Options[name.c_str()].setValue(value.c_str());
-}
-void engine_init() {
-  zobrist_init();
-  bitboard_init();
-  Threads.init();
-}
-
-void UCI::go() { Threads.start_searching(); }
+#include "bitboards.hpp"
+#include "endgame.hpp"
+#include "evaluate.hpp"
+#include "misc.hpp"
+#include "nnue.hpp"
+#include "options.hpp"
+#include "tbprobe.hpp"
+#include "threads.hpp"
+#include "tt.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+void engine_init();
+
+namespace UCI {
+bool execute(std::string const &cmd, bool fromArgs, int &exitCode);
+std::string engine_info();
+void bench(std::istream &is);
+void latency(std::istream &is);
+bool analyse(std::istream &is);
+void position(std::istream &);
+void set_option(std::istream &is);
+void go(std::istream &is);
+} // namespace UCI
+
+namespace {
+// Commands read by the input thread, run in order by the main loop
+std::deque<std::string> commands;
+std::mutex commandsMutex;
+std::condition_variable commandsCv;
+
+// std::cin is read on its own thread, so that a stop reaches the search at
+// once, even while the main loop waits on a previous command. The end of the
+// input is a quit.
+void read_input() {
+  std::string line, token;
+  while (token != "quit") {
+    if (!std::getline(std::cin, line))
+      line = "quit";
+    std::istringstream is(line);
+    token.clear();
+    is >> token;
+    if (token == "stop" || token == "quit")
+      Threads.request_stop();
+    {
+      std::lock_guard<std::mutex> lk(commandsMutex);
+      commands.push_back(line);
+    }
+    commandsCv.notify_one();
+  }
+}
+
+std::string next_command() {
+  std::unique_lock<std::mutex> lk(commandsMutex);
+  commandsCv.wait(lk, []() { return !commands.empty(); });
+  std::string cmd = commands.front();
+  commands.pop_front();
+  return cmd;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int exitCode = 0;
+  // initialisation of the engine
+  engine_init();
+  // accepts one command from the arguments, bench and perft then quit
+  bool quit = false;
+  if (argc > 1) {
+    std::string cmd;
+    for (int i = 1; i < argc; ++i)
+      cmd += std::string(argv[i]) + ' ';
+    quit = UCI::execute(cmd, true, exitCode);
+  }
+  if (quit)
+    return exitCode;
+  std::thread input(read_input);
+  while (!quit)
+    quit = UCI::execute(next_command(), false, exitCode);
+  // after a perft the input thread may still be waiting for a line
+  input.detach();
+  return exitCode;
+}
+
+namespace UCI {
+// Runs a command, returns true if the engine should quit
+bool execute(std::string const &cmd, bool fromArgs, int &exitCode) {
+  std::istringstream is(cmd);
+  std::string token;
+  is >> token;
+  if (token == "uci")
+    std::cout << Sync::lock << UCI::engine_info() << Options << "uciok"
+              << std::endl
+              << Sync::unlock;
+  else if (token == "isready")
+    std::cout << Sync::lock << "readyok" << std::endl << Sync::unlock;
+  else if (token == "ucinewgame")
+    Threads.reset();
+  else if (token == "position")
+    UCI::position(is);
+  else if (token == "bench" || token == "latency") {
+    token == "bench" ? UCI::bench(is) : UCI::latency(is);
+    if (fromArgs) {
+      Threads.terminate();
+      return true;
+    }
+  } else if (token == "go")
+    UCI::go(is);
+  else if (token == "debug") {
+    is >> token;
+    if (token == "on")
+      Options["debug"].setValue(true);
+    else
+      Options["debug"].setValue(false);
+  } else if (token == "setoption") {
+    Threads.stop_search();
+    UCI::set_option(is);
+  } else if (token == "stop")
+    Threads.stop_search();
+  else if (token == "ponderhit")
+    Threads.ponderhit();
+  else if (token == "perft") {
+    // perft [EPD file]
+    std::string file;
+    bool ok = is >> file ? Perft::perft(file) : Perft::perft();
+    exitCode = !ok;
+    Threads.terminate();
+    return true;
+  } else if (token == "analyse") {
+    exitCode = !UCI::analyse(is);
+    Threads.terminate();
+    return true;
+  } else if (token == "quit") {
+    Threads.terminate();
+    return true;
+  }
+  return false;
+}
+
+std::string engine_info() { return "id name Kitty\nid author Loli\n"; }
+
+const std::string benchPositions[] = {
+    startfen,
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+    "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1"};
+
+// bench [depth] [threads] [hash MB] : searches a fixed set of positions to a
+// fixed depth. With one thread the node count is a signature of the search.
+void bench(std::istream &is) {
+  SearchLimits limits;
+  int threads, hash;
+  if (!(is >> limits.depth))
+    limits.depth = 9;
+  if (is >> threads)
+    Options["Threads"].setValue(threads);
+  if (is >> hash)
+    Options["Hash"].setValue(hash);
+
+  Threads.stop_search();
+  TT.clear();
+  uint64_t nodes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (std::string const &fen : benchPositions) {
+    Position pos;
+    pos.set_position(fen);
+    Threads.setPosition(std::move(pos));
+    Threads.start_searching(limits);
+    Threads.wait_for_search_finished();
+    nodes += Threads.nodes_searched();
+  }
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - t0)
+                .count();
+  std::cerr << "\nTime : " << ms << " ms\nNodes : " << nodes
+            << "\nNodes/second : " << nodes * 1000 / std::max<int64_t>(ms, 1)
+            << std::endl;
+}
+
+// analyse <input> <output> [depth|nodes|threads|hash <n>] : batch analysis of
+// a FEN or EPD file, at depth 10 unless a limit is given
+bool analyse(std::istream &is) {
+  std::string input, output, token;
+  SearchLimits limits;
+  int64_t value;
+  is >> input >> output;
+  while (is >> token >> value) {
+    if (token == "depth")
+      limits.depth = value;
+    else if (token == "nodes")
+      limits.nodes = value;
+    else if (token == "threads")
+      Options["Threads"].setValue(int(value));
+    else if (token == "hash")
+      Options["Hash"].setValue(int(value));
+  }
+  if (!limits.depth && !limits.nodes)
+    limits.depth = 10;
+  return Batch::analyse(input, output, limits);
+}
+
+// latency [searches] : time from a stop to the end of the search, bestmove
+// printed, over infinite searches of the bench positions
+void latency(std::istream &is) {
+  int searches;
+  if (!(is >> searches) || searches < 1)
+    searches = 20;
+  Threads.stop_search();
+  int64_t total = 0, worst = 0;
+  for (int i = 0; i < searches; ++i) {
+    Position pos;
+    pos.set_position(benchPositions[i % std::size(benchPositions)]);
+    Threads.setPosition(std::move(pos));
+    SearchLimits limits;
+    limits.infinite = true;
+    Threads.start_searching(limits);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50 + 10 * (i % 5)));
+    auto t0 = std::chrono::steady_clock::now();
+    Threads.request_stop();
+    Threads.wait_for_search_finished();
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - t0)
+                     .count();
+    total += us;
+    worst = std::max(worst, us);
+  }
+  std::cerr << "\nSearches : " << searches
+            << "\nAverage stop latency : " << total / searches
+            << " us\nWorst stop latency : " << worst << " us" << std::endl;
+}
+
+void position(std::istream &is) {
+  std::string cmd, fen, move;
+  Position pos;
+  is >> cmd;
+  if (cmd == "startpos") {
+    pos.set_position(startfen);
+    if (!is.eof())
+      is >> move;
+  } else if (cmd == "fen") {
+    is >> fen;
+    std::string temp;
+    while (!is.eof() && temp != "moves") {
+      is >> temp;
+      fen += ' ' + temp;
+    }
+    pos.set_position(fen);
+  }
+  while (!is.eof()) {
+    is >> move;
+    pos.do_move(move);
+  }
+  pos.rebase_stack();
+  Threads.setPosition(std::move(pos));
+}
+} // namespace UCI
+
+void UCI::set_option(std::istream &is) {
+  std::string token, name, value;
+  while (!is.eof() && token != "name")
+    is >> token; // consumes "name"
+  while (!is.eof()) {
+    is >> token;
+    if (token == "value")
+      break;
+    else
+      name += token;
+  }
+  while (!is.eof()) {
+    is >> token;
+    value += token;
+  }
+  Options[name.c_str()].setValue(value.c_str());
+}
+void engine_init() {
+  zobrist_init();
+  bitboard_init();
+  Eval::init();
+  Endgames::init();
+  Threads.init();
+  TT.resize((int)Options["Hash"]);
+  // The network is mapped read-only, so that engines running side by side
+  // share it. Without one, the evaluation falls back to the material balance.
+  NNUE::load(Options["EvalFile"]);
+  Tablebases::init(Options["SyzygyPath"]);
+}
+
+// go [wtime|btime|winc|binc|movestogo|movetime|nodes|depth <n>] [infinite]
+//    [ponder]
+void UCI::go(std::istream &is) {
+  SearchLimits limits;
+  std::string token;
+  bool ponder = false;
+  while (is >> token) {
+    if (token == "wtime")
+      is >> limits.time[WHITE];
+    else if (token == "btime")
+      is >> limits.time[BLACK];
+    else if (token == "winc")
+      is >> limits.inc[WHITE];
+    else if (token == "binc")
+      is >> limits.inc[BLACK];
+    else if (token == "movestogo")
+      is >> limits.movestogo;
+    else if (token == "movetime")
+      is >> limits.movetime;
+    else if (token == "nodes")
+      is >> limits.nodes;
+    else if (token == "depth")
+      is >> limits.depth;
+    else if (token == "infinite")
+      limits.infinite = true;
+    else if (token == "ponder")
+      ponder = true;
+    else if (token == "perft")
+      break;
+  }
+  if (token == "perft") {
+    // go perft <depth> [hash MB] [threads]
+    int depth = 0, hashMB, nThreads;
+    is >> depth;
+    if (!(is >> hashMB))
+      hashMB = 16;
+    if (!(is >> nThreads))
+      nThreads = Threads.size();
+    Threads.stop_search();
+    if (depth > 0)
+      Perft::perft_divide(Threads.position(), Depth(depth),
+                          std::clamp(hashMB, 1, 65536),
+                          std::clamp(nThreads, 1, (int)Threads.size()));
+    return;
+  }
+  Threads.start_searching(limits, ponder);
+}